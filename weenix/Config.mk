@@ -43,13 +43,15 @@
 
         MOUNTING=0 # be able to mount multiple file systems
           GETCWD=0 # getcwd(3) syscall-like functionality
-        UPREEMPT=0 # userland preemption
+        UPREEMPT=1 # userland preemption
              MTP=0 # multiple kernel threads per process
          SHADOWD=1 # shadow page cleanup
+       MUTEXPROF=0 # kmutex contention and hold time statistics
+        TICKLESS=0 # LAPIC timer clock which stops while idle
 
 # Boolean options specified in this specified in this file that should be
 # included as definitions at compile time
-        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD GETCWD UPREEMPT"
+        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD GETCWD UPREEMPT MUTEXPROF TICKLESS"
 # As above, but not booleans
         COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE BOCHS_INSTALL_DIR"
 
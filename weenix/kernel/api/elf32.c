@@ -656,12 +656,19 @@ static int _elf32_load(const char *filename, int fd, char *const argv[],
         /* the final threshold / What warm unspoken secrets will we learn? / Beyond
          * the point of no return ... */
 
-        /* Give the process the new mappings. */
+        /* Give the process the new mappings. After vfork the old
+         * mappings are the parent's, and it gets them back instead. */
         vmmap_t *tempmap = curproc->p_vmmap;
+        if (NULL != curproc->p_vforkparent) {
+                proc_vfork_release(curproc);
+                tempmap = NULL;
+        }
         curproc->p_vmmap = map;
         map = tempmap; /* So the old maps are cleaned up */
         curproc->p_vmmap->vmm_proc = curproc;
-        map->vmm_proc = NULL;
+        if (NULL != map) {
+                map->vmm_proc = NULL;
+        }
 
         /* Flush the process pagetables and TLB */
         pt_unmap_range(curproc->p_pagedir, USER_MEM_LOW, USER_MEM_HIGH);
@@ -1,7 +1,13 @@
+#include "globals.h"
+
 #include "util/debug.h"
 
+#include "proc/proc.h"
+#include "proc/sched.h"
+
 #include "main/interrupt.h"
 #include "main/gdt.h"
+#include "main/fpu.h"
 
 #include "api/exec.h"
 #include "api/binfmt.h"
@@ -42,18 +48,18 @@ int do_execve(const char *filename, char *const *argv, char *const *envp, struct
         if (ret < 0) {
                 return ret;
         }
+        /* The new program must not see the old one's FPU registers */
+        fpu_release(curthr);
         /* Make sure we "return" into the start of the newly loaded binary */
         regs->r_eip = eip;
         regs->r_useresp = esp;
         return 0;
 }
 
-void kernel_execve(const char *filename, char *const *argv, char *const *envp)
+/* Enters the program just loaded into the current process, at the given
+ * instruction and stack pointers. Does not return. */
+static void userland_start(uint32_t eip, uint32_t esp)
 {
-        uint32_t eip, esp;
-        int ret = binfmt_load(filename, argv, envp, &eip, &esp);
-        KASSERT(0 == ret); /* Should never fail to load the first binary */
-
         dbg(DBG_EXEC, "Entering userland with eip %#08x, esp %#08x\n", eip, esp);
 
         /* To enter userland, we build a set of saved registers to "trick" the processor
@@ -95,3 +101,76 @@ void kernel_execve(const char *filename, char *const *argv, char *const *envp)
         regs.r_esp = 0;
         userland_entry(&regs);
 }
+
+void kernel_execve(const char *filename, char *const *argv, char *const *envp)
+{
+        uint32_t eip, esp;
+        int ret = binfmt_load(filename, argv, envp, &eip, &esp);
+        KASSERT(0 == ret); /* Should never fail to load the first binary */
+
+        userland_start(eip, esp);
+}
+
+/* What the parent hands to a spawned child, and how it hears back */
+typedef struct spawn {
+        const char   *sp_filename;
+        char *const  *sp_argv;
+        char *const  *sp_envp;
+        proc_t       *sp_parent;
+        int           sp_err;
+        int           sp_done;
+} spawn_t;
+
+/* The first thing the spawned child runs. The parent's spawn_t is on its
+ * stack, and may be gone as soon as sp_done is set. */
+static void *spawn_start(int arg1, void *arg2)
+{
+        spawn_t *sp = (spawn_t *) arg2;
+        uint32_t eip, esp;
+        int err;
+
+        err = binfmt_load(sp->sp_filename, sp->sp_argv, sp->sp_envp, &eip, &esp);
+        sp->sp_err = err;
+        sp->sp_done = 1;
+        sched_broadcast_on(&sp->sp_parent->p_wait);
+        if (err < 0) {
+                do_exit(err);
+        }
+        userland_start(eip, esp);
+        return NULL;
+}
+
+pid_t do_spawn(const char *filename, char *const *argv, char *const *envp)
+{
+        spawn_t sp;
+        proc_t *child;
+        kthread_t *thr;
+        pid_t pid;
+
+        sp.sp_filename = filename;
+        sp.sp_argv = argv;
+        sp.sp_envp = envp;
+        sp.sp_parent = curproc;
+        sp.sp_err = 0;
+        sp.sp_done = 0;
+
+        /* The child loads the program into its own, still empty,
+         * address space itself, as binfmt_load works on curproc */
+        child = proc_create((char *) filename);
+        proc_inherit_files(child);
+        thr = kthread_create(child, spawn_start, 0, &sp);
+        sched_make_runnable(thr);
+
+        /* The arguments are ours, so the child must be done with
+         * them before we return */
+        pid = child->p_pid;
+        while (!sp.sp_done) {
+                sched_sleep_on(&curproc->p_wait);
+        }
+        if (sp.sp_err < 0) {
+                /* The child has exited, dispose of it */
+                do_waitpid(pid, 0, NULL);
+                return sp.sp_err;
+        }
+        return pid;
+}
@@ -7,11 +7,13 @@
 
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/sched.h"
 
 #include "util/init.h"
 #include "util/string.h"
 #include "util/debug.h"
 #include "util/list.h"
+#include "util/time.h"
 
 #include "mm/mman.h"
 #include "mm/mm.h"
@@ -25,11 +27,13 @@
 #include "test/kshell/kshell.h"
 
 #include "vm/brk.h"
+#include "vm/futex.h"
 #include "vm/mmap.h"
 #include "vm/vmmap.h"
 
 #include "api/syscall.h"
 #include "api/utsname.h"
+#include "api/time.h"
 #include "api/access.h"
 #include "api/exec.h"
 
@@ -594,6 +598,197 @@ static void sys_sync(void)
         pframe_clean_all();
 }
 
+/*
+ * Sleeps for at least msecs milliseconds, rounded up to whole clock
+ * ticks. Returns early with EINTR if the thread is cancelled. The
+ * next tick may come at any moment, so it does not count towards the
+ * sleep.
+ */
+static int sys_sleep(uint32_t msecs)
+{
+        ktqueue_t               q;
+        int                     err;
+
+        sched_queue_init(&q);
+        err = sched_cancellable_sleep_on_timeout(&q, MSECS_TO_TICKS(msecs) + 1);
+        if (-EINTR == err) {
+                curthr->kt_errno = EINTR;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_getrusage(getrusage_args_t *arg)
+{
+        getrusage_args_t        kern_args;
+        struct rusage           ru;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0
+            || (err = proc_getrusage(kern_args.gra_who, &ru)) < 0
+            || (err = copy_to_user(kern_args.gra_usage, &ru, sizeof(ru))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_futex(futex_args_t *arg)
+{
+        futex_args_t            kern_args;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        switch (kern_args.fxa_op) {
+                case FUTEX_WAIT:
+                        err = futex_wait(kern_args.fxa_addr, kern_args.fxa_val);
+                        break;
+                case FUTEX_WAKE:
+                        err = futex_wake(kern_args.fxa_addr, kern_args.fxa_val);
+                        break;
+                default:
+                        err = -EINVAL;
+                        break;
+        }
+        if (err < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return err;
+}
+
+static int sys_clock_gettime(clock_gettime_args_t *arg)
+{
+        clock_gettime_args_t    kern_args;
+        struct timespec         ts;
+        uint64_t                nsecs;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (CLOCK_MONOTONIC != kern_args.cga_clock) {
+                curthr->kt_errno = EINVAL;
+                return -1;
+        }
+
+        nsecs = time_nsecs();
+        ts.tv_sec = (long)(nsecs / 1000000000);
+        ts.tv_nsec = (long)(nsecs % 1000000000);
+        if ((err = copy_to_user(kern_args.cga_tp, &ts, sizeof(ts))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+#ifdef __MTP__
+static int sys_thr_create(thr_create_args_t *arg, regs_t *regs)
+{
+        thr_create_args_t       kern_args;
+        regs_t                  thr_regs;
+        kthread_t              *thr;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        /* The new thread starts from a copy of our registers, just
+         * like a forked child, but on its own stack */
+        thr_regs = *regs;
+        thr_regs.r_eip = (uint32_t) kern_args.tca_eip;
+        thr_regs.r_useresp = (uint32_t) kern_args.tca_esp;
+        thr_regs.r_ebp = 0;
+        thr_regs.r_eax = 0;
+
+        if (NULL == (thr = do_thr_create(&thr_regs))) {
+                curthr->kt_errno = ENOMEM;
+                return -1;
+        }
+        if (NULL != kern_args.tca_tidp) {
+                err = copy_to_user(kern_args.tca_tidp, &thr->kt_tid, sizeof(thr->kt_tid));
+                if (err < 0) {
+                        kthread_destroy(thr);
+                        curthr->kt_errno = -err;
+                        return -1;
+                }
+                thr->kt_cleartid = kern_args.tca_tidp;
+        }
+
+        sched_make_runnable(thr);
+        return thr->kt_tid;
+}
+
+static int sys_thr_join(thr_join_args_t *arg)
+{
+        thr_join_args_t         kern_args;
+        kthread_t              *thr;
+        void                   *retval;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (NULL == (thr = kthread_lookup(curproc, kern_args.tja_tid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        if ((err = kthread_join(thr, &retval)) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (NULL != kern_args.tja_retval
+            && (err = copy_to_user(kern_args.tja_retval, &retval, sizeof(retval))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_thr_detach(int tid)
+{
+        kthread_t              *thr;
+        int                     err;
+
+        if (NULL == (thr = kthread_lookup(curproc, tid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        if ((err = kthread_detach(thr)) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int sys_thr_cancel(thr_cancel_args_t *arg)
+{
+        thr_cancel_args_t       kern_args;
+        kthread_t              *thr;
+        int                     err;
+
+        if ((err = copy_from_user(&kern_args, arg, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        if (NULL == (thr = kthread_lookup(curproc, kern_args.tcla_tid))
+            || KT_EXITED == thr->kt_state) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+        kthread_cancel(thr, kern_args.tcla_retval);
+        return 0;
+}
+#endif
+
 static void sys_halt(void)
 {
         proc_kill_all();
@@ -678,6 +873,16 @@ static int sys_fork(regs_t *regs)
         return ret;
 }
 
+static int sys_vfork(regs_t *regs)
+{
+        int ret = do_vfork(regs);
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
 static void free_vector(char **vect)
 {
         char **temp;
@@ -731,6 +936,43 @@ cleanup:
         return 0;
 }
 
+static int sys_spawn(execve_args_t *args)
+{
+        execve_args_t kern_args;
+        char *kern_filename = NULL;
+        char **kern_argv = NULL;
+        char **kern_envp = NULL;
+        int err;
+
+        if ((err = copy_from_user(&kern_args, args, sizeof(kern_args))) < 0)
+                goto cleanup;
+
+        /* these set errno themselves when they fail */
+        if ((kern_filename = user_strdup(&kern_args.filename)) == NULL
+            || (kern_args.argv.av_vec
+                && (kern_argv = user_vecdup(&kern_args.argv)) == NULL)
+            || (kern_args.envp.av_vec
+                && (kern_envp = user_vecdup(&kern_args.envp)) == NULL)) {
+                err = -curthr->kt_errno;
+                goto cleanup;
+        }
+
+        err = do_spawn(kern_filename, kern_argv, kern_envp);
+
+cleanup:
+        if (kern_filename)
+                kfree(kern_filename);
+        if (kern_argv)
+                free_vector(kern_argv);
+        if (kern_envp)
+                free_vector(kern_envp);
+        if (err < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return err;
+}
+
 static int sys_debug(argstr_t *arg)
 {
         argstr_t kern_args;
@@ -791,6 +1033,7 @@ static void syscall_handler(regs_t *regs)
 
         dbginfo(DBG_VMMAP, vmmap_mapping_info, curproc->p_vmmap);
 
+        curproc->p_nsyscall++;
         int ret = syscall_dispatch(sysnum, args, regs);
 
         if (curthr->kt_cancelled) {
@@ -821,13 +1064,47 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                         panic("thr_exit failed!\n");
                         return 0;
 
+#ifdef __MTP__
+                case SYS_thr_create:
+                        return sys_thr_create((thr_create_args_t *)args, regs);
+
+                case SYS_thr_join:
+                        return sys_thr_join((thr_join_args_t *)args);
+
+                case SYS_thr_detach:
+                        return sys_thr_detach((int)args);
+
+                case SYS_thr_cancel:
+                        return sys_thr_cancel((thr_cancel_args_t *)args);
+
+                case SYS_gettid:
+                        return curthr->kt_tid;
+#endif
+
                 case SYS_thr_yield:
                         sched_make_runnable(curthr);
                         sched_switch();
                         return 0;
 
+                case SYS_nice:
+                        return sched_nice(curproc, (int)args);
+
+                case SYS_sleep:
+                        return sys_sleep((uint32_t)args);
+
+                case SYS_clock_gettime:
+                        return sys_clock_gettime((clock_gettime_args_t *)args);
+
+                case SYS_futex:
+                        return sys_futex((futex_args_t *)args);
+
+                case SYS_getrusage:
+                        return sys_getrusage((getrusage_args_t *)args);
+
                 case SYS_fork:
                         return sys_fork(regs);
+                case SYS_vfork:
+                        return sys_vfork(regs);
 
                 case SYS_getpid:
                         return curproc->p_pid;
@@ -908,6 +1185,8 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
 
                 case SYS_execve:
                         return sys_execve((execve_args_t *)args, regs);
+                case SYS_spawn:
+                        return sys_spawn((execve_args_t *)args);
 
                 case SYS_stat:
                         return sys_stat((stat_args_t *)args);
@@ -55,7 +55,9 @@ lookup(vnode_t *dir, const char *name, size_t len, vnode_t **result)
              {
                 *result=dir->
              }*/
+            vlock_shared(dir);
             int ret = dir->vn_ops->lookup(dir,name,len,result);
+            vunlock(dir);
             dbg(DBG_VFS,"VFS: Leave lookup(), find %s, error=%d\n", name, ret);
             return ret;
         }
@@ -275,7 +277,9 @@ open_namev(const char *pathname, int flag, vnode_t **res_vnode, vnode_t *base)
             else if((err==-ENOENT)&&flag&&(par->vn_ops->create!=NULL))
             {
                 KASSERT(NULL != par->vn_ops->create);
+                vlock(par);
                 int ret = par->vn_ops->create(par,name,len,res_vnode);
+                vunlock(par);
                 vput(par);
                 dbg(DBG_VFS,"VFS: Leave open_namev(), file not exist, create file\n");
                 return 0;
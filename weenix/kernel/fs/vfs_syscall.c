@@ -67,7 +67,9 @@ do_read(int fd, void *buf, size_t nbytes)
             fput(file);
             return 0;
         }
+        vlock_shared(file->f_vnode);
         unsigned int bytes=file->f_vnode->vn_ops->read(file->f_vnode,file->f_pos,buf,nbytes);
+        vunlock(file->f_vnode);
         if(bytes==nbytes)
         {
             do_lseek(fd,bytes,SEEK_CUR); 
@@ -116,6 +118,8 @@ do_write(int fd, const void *buf, size_t nbytes)
         }
 
         int bytes;
+        /* held across the seek so appends do not interleave */
+        vlock(file->f_vnode);
         if(file->f_mode&FMODE_APPEND)
         {
                 do_lseek(fd,0,SEEK_END);
@@ -135,6 +139,7 @@ do_write(int fd, const void *buf, size_t nbytes)
                         ((S_ISREG(file->f_vnode->vn_mode)) && (file->f_pos <= file->f_vnode->vn_len)));
                 dbg(DBG_VFS,"VFS: Leave do_write(), success, return %d\n",bytes); 
         }
+        vunlock(file->f_vnode);
         fput(file);
         return bytes;
 }
@@ -326,7 +331,9 @@ do_mknod(const char *path, int mode, unsigned devid)
                 if (error == -ENOENT)
                 {
                         KASSERT(NULL != dir->vn_ops->mknod);
+                        vlock(dir);
                         int ret = dir->vn_ops->mknod(dir, name, namelen, mode, (devid_t)devid);
+                        vunlock(dir);
                         vput(dir);
                         dbg(DBG_VFS,"VFS: Leave do_mknod(), error cannot find name, throw ENOENT\n");
                         return ret;
@@ -386,7 +393,9 @@ do_mkdir(const char *path)
         /* Call the dir's mkdir vn_ops. Return what it returns.*/
         KASSERT(NULL != dir_vnode->vn_ops->mkdir);
         dbg(DBG_VFS,"VFS:In do_mkdir(), before ramfs_mkdir path=%s\n", path);
+        vlock(dir_vnode);
         err = dir_vnode -> vn_ops -> mkdir(dir_vnode, name, namelen);
+        vunlock(dir_vnode);
         vput(dir_vnode);
         dbg(DBG_VFS,"VFS: Leave do_mkdir(), err=%d\n", err);
         return err;
@@ -454,7 +463,9 @@ do_rmdir(const char *path)
         }
         /* Call the containing dir's rmdir v_op. */
         KASSERT(NULL != dir_vnode->vn_ops->rmdir);
+        vlock(dir_vnode);
         err = dir_vnode -> vn_ops -> rmdir(dir_vnode, name, namelen);
+        vunlock(dir_vnode);
         vput(dir_vnode);
         /* Need vput()? */
         dbg(DBG_VFS,"VFS: Leave do_rmdir()\n");
@@ -512,7 +523,9 @@ do_unlink(const char *path)
         
         /* reomve the result vnode from the directory*/
         KASSERT(NULL != dir->vn_ops->unlink);
+        vlock(dir);
         int ret = dir->vn_ops->unlink(dir, name, namelen);
+        vunlock(dir);
         vput(result);
         vput(dir);
         dbg(DBG_VFS,"VFS: Leave do_unlink(), sucess\n");
@@ -584,7 +597,9 @@ do_link(const char *from, const char *to)
                 return -ENOTDIR;
         }
         /* call the destination dir's (to) link vn_ops; 'from_vnode' refcount++ in link()*/
+        vlock(to_dir);
         int ret = to_dir->vn_ops->link(from_vnode, to_dir, name, namelen);
+        vunlock(to_dir);
 
         /* vput the vnodes returned from open_namev and dir_namev */
         vput(from_vnode);
@@ -696,7 +711,9 @@ do_getdent(int fd, struct dirent *dirp)
         }
 
         int bytes;
+        vlock_shared(file->f_vnode);
         bytes=file->f_vnode->vn_ops->readdir(file->f_vnode,file->f_pos,dirp);
+        vunlock(file->f_vnode);
         /*do_lseek(fd,bytes,SEEK_CUR);*/
         fput(file);
         /*dbg(DBG_DISK,"VFS: Leaving do_getdent()\n");*/
@@ -828,7 +845,9 @@ do_stat(const char *path, struct stat *buf)
             {
                 vput(par);
                 KASSERT(chd->vn_ops->stat);
+                vlock_shared(chd);
                 chd->vn_ops->stat(chd,buf);
+                vunlock(chd);
                 vput(chd);
                 dbg(DBG_VFS,"VFS: Leave do_stat(), success.\n");
                 return 0;
@@ -14,6 +14,7 @@
 #include "fs/vfs.h"
 #include "fs/vnode.h"
 #include "mm/slab.h"
+#include "proc/proc.h"
 #include "proc/sched.h"
 #include "util/debug.h"
 #include "vm/vmmap.h"
@@ -111,6 +112,30 @@ vref(vnode_t *vn)
             vn, vn->vn_fs, (long)vn->vn_vno, vn->vn_refcount, vn->vn_nrespages);
 }
 
+/* Only regular files and directories are locked, see vnode.h */
+#define VN_LOCKABLE(vn) (S_ISREG((vn)->vn_mode) || S_ISDIR((vn)->vn_mode))
+
+void
+vlock_shared(vnode_t *vn)
+{
+        if (VN_LOCKABLE(vn))
+                krwlock_rdlock(&vn->vn_rwlock);
+}
+
+void
+vlock(vnode_t *vn)
+{
+        if (VN_LOCKABLE(vn))
+                krwlock_wrlock(&vn->vn_rwlock);
+}
+
+void
+vunlock(vnode_t *vn)
+{
+        if (VN_LOCKABLE(vn))
+                krwlock_unlock(&vn->vn_rwlock);
+}
+
 vnode_t *
 vget(struct fs *fs, ino_t vno)
 {
@@ -166,6 +191,7 @@ find:
         vn->vn_fs = fs;
         vn->vn_vno = vno;
         kmutex_init(&vn->vn_mutex);
+        krwlock_init(&vn->vn_rwlock);
         mmobj_init(&vn->vn_mmobj, &vnode_mmobj_ops);
         sched_queue_init(&vn->vn_waitq);
 
@@ -192,6 +218,8 @@ find:
         vn->vn_fs->fs_op->read_vnode(vn);
 
         vn->vn_flags &= ~VN_BUSY;
+        /*     anyone who found it busy can now take a reference: */
+        sched_broadcast_on(&vn->vn_waitq);
 
         /*     for special files: */
         if (S_ISCHR(vn->vn_mode) || S_ISBLK(vn->vn_mode))
@@ -661,6 +689,9 @@ vreadpage(mmobj_t *o, pframe_t *pf)
         KASSERT(NULL != o);
 
         vnode_t *v = mmobj_to_vnode(o);
+        /* Charged to whoever is waiting for it */
+        if (S_ISREG(v->vn_mode) || S_ISDIR(v->vn_mode))
+                curproc->p_inblock++;
         return v->vn_ops->fillpage(v, (int)PN_TO_ADDR(pf->pf_pagenum), pf->pf_addr);
 }
 
@@ -685,5 +716,8 @@ vcleanpage(mmobj_t *o, pframe_t *pf)
         KASSERT(NULL != o);
 
         vnode_t *v = mmobj_to_vnode(o);
+        /* Charged to whoever is cleaning it, often pageoutd */
+        if (S_ISREG(v->vn_mode) || S_ISDIR(v->vn_mode))
+                curproc->p_oublock++;
         return v->vn_ops->cleanpage(v, (int) PN_TO_ADDR(pf->pf_pagenum), pf->pf_addr);
 }
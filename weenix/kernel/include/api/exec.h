@@ -8,4 +8,11 @@ int do_execve(const char *filename, char *const *argv, char *const *envp, struct
 
 void kernel_execve(const char *filename, char *const *argv, char *const *envp);
 
+/* Creates a child of the current process running the given program,
+ * as fork() followed immediately by execve() in the child would, but
+ * without ever copying the parent's address space. The child inherits
+ * the open files and working directory. Returns the child's pid, or
+ * -errno if the program could not be loaded. */
+pid_t do_spawn(const char *filename, char *const *argv, char *const *envp);
+
 void userland_entry(const struct regs *regs);
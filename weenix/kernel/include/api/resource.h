@@ -0,0 +1,22 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+/* Whose resource usage getrusage() reports */
+#define RUSAGE_SELF     0       /* the calling process */
+#define RUSAGE_CHILDREN (-1)    /* all of its children which it has waited for */
+
+struct rusage {
+        unsigned long ru_runtime;       /* milliseconds spent running */
+        unsigned long ru_waittime;      /* milliseconds spent runnable but waiting */
+        unsigned long ru_minflt;        /* page faults needing no I/O */
+        unsigned long ru_majflt;        /* page faults which had to read a page in */
+        unsigned long ru_cowflt;        /* pages copied on write */
+        unsigned long ru_inblock;       /* file pages read in */
+        unsigned long ru_oublock;       /* file pages written back */
+        unsigned long ru_nsyscall;      /* system calls made */
+        unsigned long ru_nvcsw;         /* voluntary context switches */
+        unsigned long ru_nivcsw;        /* involuntary context switches */
+};
+
+int getrusage(int who, struct rusage *usage);
@@ -2,11 +2,13 @@
 
 /* Kernel and user header (via symlink) */
 
+#ifndef __ASSEMBLY__
 #ifdef __KERNEL__
 #include "types.h"
 #else
 #include "sys/types.h"
 #endif
+#endif
 
 /* Trap number for syscalls */
 #define INTR_SYSCALL 0x2e
@@ -25,7 +27,7 @@
 #define SYS_unlink              9
 #define SYS_execve              10
 #define SYS_chdir               11
-#define SYS_sleep               12 /* NYI */
+#define SYS_sleep               12
 #define SYS_lseek               14
 #define SYS_sync                15
 #define SYS_nuke                16 /* NYI */
@@ -40,13 +42,14 @@
 #define SYS_munmap              26
 #define SYS_rename              27 /* NYI */
 #define SYS_uname               28
-#define SYS_thr_create          29 /* NYI */
+#define SYS_thr_create          29
 #define SYS_thr_cancel          30
 #define SYS_thr_exit            31
 #define SYS_thr_yield           32
-#define SYS_thr_join            33 /* NYI */
-#define SYS_gettid              34 /* NYI */
+#define SYS_thr_join            33
+#define SYS_gettid              34
 #define SYS_getpid              35
+#define SYS_thr_detach          36
 #define SYS_errno               39
 #define SYS_halt                40
 #define SYS_get_free_mem        41 /* NYI */
@@ -56,6 +59,16 @@
 #define SYS_mount               45
 #define SYS_umount              46
 #define SYS_stat                47
+#define SYS_nice                48
+#define SYS_clock_gettime       49
+#define SYS_futex               50
+#define SYS_vfork               51
+#define SYS_spawn               52 /* takes an execve_args_t */
+#define SYS_getrusage           53
+
+/* futex operations */
+#define FUTEX_WAIT              0       /* sleep if *addr == val */
+#define FUTEX_WAKE              1       /* wake up to val sleepers */
 
 /*
  * ... what does the scouter say about his syscall?
@@ -65,8 +78,12 @@
 #define SYS_debug               9001
 #define SYS_kshell              9002
 
+#ifndef __ASSEMBLY__
+
 struct regs;
 struct stat;
+struct timespec;
+struct rusage;
 
 typedef struct argstr {
         const char *as_str;
@@ -167,4 +184,39 @@ typedef struct stat_args {
         struct stat *buf;
 } stat_args_t;
 
+typedef struct thr_create_args {
+        void    *tca_eip;       /* where the new thread starts executing */
+        void    *tca_esp;       /* the new thread's stack pointer */
+        int     *tca_tidp;      /* set to the new thread's id before it runs,
+                                 * and to 0 when it exits (may be NULL) */
+} thr_create_args_t;
+
+typedef struct thr_join_args {
+        int      tja_tid;
+        void   **tja_retval;
+} thr_join_args_t;
+
+typedef struct thr_cancel_args {
+        int      tcla_tid;
+        void    *tcla_retval;
+} thr_cancel_args_t;
+
+typedef struct clock_gettime_args {
+        int              cga_clock;
+        struct timespec *cga_tp;
+} clock_gettime_args_t;
+
+typedef struct futex_args {
+        int     *fxa_addr;
+        int      fxa_op;
+        int      fxa_val;
+} futex_args_t;
+
+typedef struct getrusage_args {
+        int              gra_who;
+        struct rusage   *gra_usage;
+} getrusage_args_t;
+
 struct utsname;
+
+#endif /* __ASSEMBLY__ */
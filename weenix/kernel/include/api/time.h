@@ -0,0 +1,14 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+/* The only clock: nanoseconds since boot, never adjusted and never
+ * going backwards */
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+        long tv_sec;    /* seconds */
+        long tv_nsec;   /* nanoseconds, less than one second */
+};
+
+int clock_gettime(int clock_id, struct timespec *tp);
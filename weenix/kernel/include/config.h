@@ -11,8 +11,16 @@
 /*
  * kernel configuration parameters
  */
-#define DEFAULT_STACK_SIZE      (56*1024) /* size of stacks */
+#define DEFAULT_STACK_SIZE      (56*1024) /* size of user stacks */
+#define KSTACK_SIZE             (24*1024) /* size of kernel stacks, not counting the guard page */
+#define KSTACK_POOL_SIZE        16        /* free kernel stacks kept around for reuse */
 #define TICK_MSECS              10        /* msecs between clock interrupts */
+#define SCHED_QUANTUM_TICKS     5         /* clock ticks in a top priority time slice */
+#define SCHED_NPRIO             8         /* number of run queue priority levels */
+#define SCHED_BOOST_TICKS       100       /* clock ticks between priority resets */
+#define PROC_PID_HASH_SIZE      256       /* buckets in the pid->process table */
+#define KMUTEX_PROF_SLOTS       1024      /* mutexes the profiler keeps statistics for */
+#define KMUTEX_PROF_SITES       32        /* callers of the kmutex_init function it tells apart */
 
 /*
  * Memory-management-related:
@@ -29,6 +37,10 @@
 /*         Pageout-related: */
 #define PAGEOUTD_FREE_TARGET_SHIFT     5 /* 3.125% */
 #define PAGEOUTD_FREE_MIN_SHIFT        4 /* 6.25% */
+/*     anonymous-object-related: */
+#define ANON_ZERO_POOL_SIZE           64 /* free pages zeroed ahead of time when idle */
+/*     futex-related: */
+#define FUTEX_HASH_SIZE               31 /* Number of buckets in the futex hash */
 
 
 /*
@@ -13,6 +13,7 @@
 #include "drivers/bytedev.h"
 #include "util/list.h"
 #include "proc/kmutex.h"
+#include "proc/krwlock.h"
 #include "mm/mmobj.h"
 #include "mm/pframe.h"
 
@@ -252,6 +253,16 @@ typedef struct vnode {
         int                vn_flags;       /* VN_BUSY */
         ktqueue_t          vn_waitq;       /* queue of threads waiting for vnode
                                               to become not busy */
+
+        /*
+         * Synchronizes the vnode operations on regular files and
+         * directories. The VFS layer holds it shared around read, lookup,
+         * readdir and stat, and exclusive around everything which changes
+         * the file, so that lookups and reads of the same file or directory
+         * can run at once. The filesystem's own vn_mutex is taken inside
+         * it. See vlock().
+         */
+        krwlock_t          vn_rwlock;
 } vnode_t;
 
 /* Core vnode management routines: */
@@ -324,6 +335,19 @@ void vref(vnode_t *vn);
  */
 void vput(vnode_t *vn);
 
+/*
+ *     Lock a vnode around a call to one of its operations: shared for
+ *     operations which only look (read, lookup, readdir, stat), and
+ *     exclusive for those which change the file or directory. Device
+ *     vnodes are never locked, since a read of a terminal may block
+ *     indefinitely and the drivers do their own synchronization.
+ *
+ *     MAY BLOCK.
+ */
+void vlock_shared(vnode_t *vn);
+void vlock(vnode_t *vn);
+void vunlock(vnode_t *vn);
+
 
 /* Auxilliary: */
 
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.h"
+
+struct kthread;
+
+/*
+ * Lazy x87/SSE state switching. The kernel itself never uses the FPU,
+ * so FPU state belongs to user threads only. At any time at most one
+ * thread's state is live in the FPU registers (the owner). Switching to
+ * any other thread sets CR0.TS, so its first FPU instruction raises
+ * #NM, and only then is the owner's state saved and the new thread's
+ * loaded. A thread's FXSAVE area is not allocated until its first FPU
+ * instruction, so threads which never use the FPU pay nothing for it
+ * beyond a CR0 write on context switch.
+ */
+
+/* Size of an FXSAVE area, plus slack so it can be aligned to 16 bytes */
+#define FPU_STATE_SIZE (512 + 15)
+
+/**
+ * Called by the scheduler just before switching to the given thread.
+ * Leaves the FPU usable if the thread owns it and makes it trap
+ * otherwise.
+ *
+ * @param thr the thread about to run
+ */
+void fpu_switch(struct kthread *thr);
+
+/**
+ * Handles the #NM (device not available) trap of the current thread by
+ * giving it the FPU, saving the previous owner's state and loading the
+ * current thread's, or a freshly initialized state on its first use.
+ *
+ * @return 0 on success, or -ENOMEM if the thread has no FPU state yet
+ * and none could be allocated, or -ENOSYS if the processor does not
+ * support FXSAVE
+ */
+int fpu_trap(void);
+
+/**
+ * Gives the new thread a copy of the old thread's FPU state, if the
+ * old thread has any. If it cannot be allocated the new thread starts
+ * with a fresh state on its first FPU instruction.
+ *
+ * @param old the thread being cloned, which must be the current thread
+ * @param new the new thread
+ */
+void fpu_clone(struct kthread *old, struct kthread *new);
+
+/**
+ * Frees a thread's FPU state when the thread is destroyed, or when the
+ * current thread execs a new program, which starts with a freshly
+ * initialized state on its first FPU instruction.
+ *
+ * @param thr the thread being destroyed, or the current thread
+ */
+void fpu_release(struct kthread *thr);
@@ -10,6 +10,7 @@
 #define GDT_USER_TEXT   0x18
 #define GDT_USER_DATA   0x20
 #define GDT_TSS         0x28
+#define GDT_DF_TSS      0x30 /* task the double fault handler runs as */
 
 void gdt_init(void);
 
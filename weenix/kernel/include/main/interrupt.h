@@ -7,8 +7,11 @@
 
 #define INTR_DIVIDE_BY_ZERO 0x00
 #define INTR_INVALID_OPCODE 0x06
+#define INTR_DEVICE_NOT_AVAILABLE 0x07
 #define INTR_GPF 0x0d
 #define INTR_PAGE_FAULT 0x0e
+#define INTR_FPU_ERROR 0x10
+#define INTR_SIMD_ERROR 0x13
 
 #define INTR_PIT 0xf1
 #define INTR_APICTIMER 0xf0
@@ -3,6 +3,11 @@
 #include "types.h"
 
 /* Starts the Programmable Interval Timer (PIT)
- * delivering periodic interrupts at 1000 Hz
- * (i.e., one every millisecond) to the given interrupt. */
+ * delivering periodic interrupts every TICK_MSECS
+ * milliseconds (see config.h) to the given interrupt. */
 void pit_starttimer(uint8_t intr);
+
+/* Spins for the given number of milliseconds (at most 54) using
+ * channel 2 of the PIT, which is independent of the periodic timer.
+ * Meant for calibrating other clocks against the PIT at boot. */
+void pit_busywait(uint32_t msecs);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "types.h"
+
 #include "proc/sched.h"
 
 typedef struct kmutex {
@@ -7,6 +9,28 @@ typedef struct kmutex {
         struct kthread *km_holder;      /* current holder */
 } kmutex_t;
 
+#ifdef __MUTEXPROF__
+/*
+ * Profiling statistics, shared by every mutex initialized at the same
+ * call site of kmutex_init (e.g. all vnode mutexes). Times are in
+ * time stamp counter cycles. kmutex_t is embedded in structures laid
+ * out by the prebuilt libraries, so it cannot grow to say which class
+ * a mutex belongs to; a table on the side, keyed by address, does.
+ */
+typedef struct kmutex_class {
+        const char     *kc_name;        /* the argument to kmutex_init, or NULL */
+        uintptr_t       kc_site;        /* if kc_name is NULL, the caller of kmutex_init */
+        list_link_t     kc_link;        /* link on the list of all classes */
+        uint32_t        kc_nlocks;      /* number of acquisitions */
+        uint32_t        kc_ncontended;  /* acquisitions which had to sleep */
+        uint64_t        kc_waittime;    /* total cycles spent sleeping for it */
+        uint64_t        kc_maxwait;     /* longest sleep for it */
+        uint64_t        kc_holdtime;    /* total cycles it was held */
+        uint64_t        kc_maxhold;     /* longest time it was held */
+        int             kc_lastpid;     /* process of the last thread to release it */
+} kmutex_class_t;
+#endif
+
 /**
  * Initializes the fields of the specified kmutex_t.
  *
@@ -45,3 +69,32 @@ int  kmutex_lock_cancellable(kmutex_t *mtx);
  * @mtx the mutex to unlock
  */
 void kmutex_unlock(kmutex_t *mtx);
+
+#ifdef __MUTEXPROF__
+/**
+ * Initializes the fields of the specified kmutex_t and makes it
+ * report its statistics to the given class, registering the class
+ * with the profiler if this is its first mutex.
+ *
+ * @param mtx the mutex to initialize
+ * @param cls the class to account the mutex to
+ */
+void kmutex_init_class(kmutex_t *mtx, kmutex_class_t *cls);
+
+/* Gives every call site of kmutex_init its own class */
+#define kmutex_init(mtx)                                                \
+        do {                                                            \
+                static kmutex_class_t __kmutex_class = { .kc_name = #mtx }; \
+                kmutex_init_class((mtx), &__kmutex_class);              \
+        } while (0)
+
+/**
+ * Provides the statistics of the most contended mutex classes.
+ *
+ * @param arg pointer to an int, the number of classes to show
+ * @param buf the buffer to print into
+ * @param osize the size of buf
+ * @return the number of bytes of buf left unused
+ */
+size_t kmutex_prof_info(const void *arg, char *buf, size_t osize);
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "types.h"
+
+#include "proc/sched.h"
+
+/*
+ * A reader-writer lock. Any number of threads may hold it shared, or
+ * one thread may hold it exclusive. Writers are preferred: once a
+ * writer is waiting, new readers wait behind it, so a steady stream of
+ * readers cannot starve writers. When a writer lets go, the next
+ * waiting writer goes first and readers are let in once no writers
+ * are left.
+ *
+ * Like kmutex_t, this is for thread context only, and it is not
+ * re-entrant in either mode.
+ */
+typedef struct krwlock {
+        ktqueue_t       krw_rdq;        /* readers waiting */
+        ktqueue_t       krw_wrq;        /* writers waiting */
+        int             krw_readers;    /* threads holding it shared */
+        int             krw_wrwant;     /* writers waiting or woken but not
+                                         * yet running */
+        struct kthread *krw_writer;     /* thread holding it exclusive */
+} krwlock_t;
+
+/**
+ * Initializes the fields of the specified krwlock_t.
+ *
+ * @param rw the lock to initialize
+ */
+void krwlock_init(krwlock_t *rw);
+
+/**
+ * Takes the lock shared. Blocks while a writer holds the lock or is
+ * waiting for it.
+ *
+ * Note: This function may block.
+ *
+ * @param rw the lock
+ */
+void krwlock_rdlock(krwlock_t *rw);
+
+/**
+ * Takes the lock shared, but puts the current thread into a
+ * cancellable sleep if the function blocks.
+ *
+ * Note: This function may block.
+ *
+ * @param rw the lock
+ * @return 0 if the current thread now holds the lock shared and
+ * -EINTR if the sleep was cancelled and it does not
+ */
+int  krwlock_rdlock_cancellable(krwlock_t *rw);
+
+/**
+ * Takes the lock exclusive. Blocks while anyone else holds it.
+ *
+ * Note: This function may block.
+ *
+ * @param rw the lock
+ */
+void krwlock_wrlock(krwlock_t *rw);
+
+/**
+ * Takes the lock exclusive, but puts the current thread into a
+ * cancellable sleep if the function blocks.
+ *
+ * Note: This function may block.
+ *
+ * @param rw the lock
+ * @return 0 if the current thread now holds the lock exclusive and
+ * -EINTR if the sleep was cancelled and it does not
+ */
+int  krwlock_wrlock_cancellable(krwlock_t *rw);
+
+/**
+ * Releases the lock, whichever way the current thread holds it.
+ *
+ * @param rw the lock
+ */
+void krwlock_unlock(krwlock_t *rw);
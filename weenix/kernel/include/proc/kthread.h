@@ -29,7 +29,23 @@ typedef struct kthread {
 #ifdef __MTP__
         int             kt_detached;    /* if the thread has been detached */
         ktqueue_t       kt_joinq;       /* thread waiting to join with this thread */
+        int             kt_tid;         /* thread id, unique within the process */
+        int            *kt_cleartid;    /* userland address zeroed when the thread exits, or NULL */
+        int             kt_joined;      /* if a thread is joining (or has joined) with this one */
 #endif
+        /* The fields above are laid out as the prebuilt libraries
+         * expect, anything new goes below */
+        uint32_t        kt_wwant;       /* units an exclusive sleeper waits for,
+                                         * 0 if the sleep is not exclusive */
+        int             kt_prio;        /* run queue level, 0 is the highest */
+        int             kt_quantum;     /* clock ticks left in this thread's time slice */
+        int             kt_preempt;     /* 1 if the thread should yield on its way back to userland */
+        uint32_t        kt_stamp;       /* tick at which the thread last started running or waiting to */
+        uint32_t        kt_runtime;     /* clock ticks spent running */
+        uint32_t        kt_waittime;    /* clock ticks spent runnable on the run queue */
+        uint32_t        kt_nvcsw;       /* voluntary context switches (blocked or exited) */
+        uint32_t        kt_nivcsw;      /* involuntary context switches (preempted or yielded) */
+        void           *kt_fpu;         /* FXSAVE area, allocated on first FPU use (see main/fpu.h) */
 } kthread_t;
 
 /* thread states */
@@ -53,6 +69,17 @@ void kthread_init(void);
  */
 kthread_t *kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2);
 
+/**
+ * Checks whether an address lies in the unmapped guard page below a
+ * thread's kernel stack, i.e. whether accessing it means the stack
+ * has overflowed.
+ *
+ * @param t the thread whose stack to check
+ * @param addr the address to check
+ * @return nonzero if addr is in the guard page of t's stack
+ */
+int kthread_stack_guarded(kthread_t *t, uintptr_t addr);
+
 /**
  * Free resources associated with a thread.
  *
@@ -84,13 +111,23 @@ void kthread_exit(void *retval);
 kthread_t *kthread_clone(kthread_t *thr);
 
 #ifdef __MTP__
+/**
+ * Finds a thread of a process by its thread id.
+ *
+ * @param p the process to search
+ * @param tid the thread id to look for
+ * @return the thread, or NULL if p has no such thread
+ */
+kthread_t *kthread_lookup(struct proc *p, int tid);
+
 /**
  * Shuts down the reaper daemon.
  */
 void kthread_reapd_shutdown(void);
 
 /**
- * Put a thread in the detached state.
+ * Put a thread in the detached state. A detached thread is freed by
+ * the reaper daemon as soon as it exits, and cannot be joined.
  *
  * @param kthr the thread to put in the detached state
  * @return 0 on sucess and <0 on error
@@ -98,7 +135,8 @@ void kthread_reapd_shutdown(void);
 int kthread_detach(kthread_t *kthr);
 
 /**
- * Wait for the termination of another thread.
+ * Wait for the termination of another thread, then free it. At most
+ * one thread may wait for a given thread.
  *
  * @param kthr the thread to wait for
  * @param retval if retval is not NULL, the return value for kthr is
@@ -8,6 +8,8 @@
 
 #include "vm/vmmap.h"
 
+#include "api/resource.h"
+
 #include "config.h"
 
 #define PROC_MAX_COUNT  65536
@@ -44,6 +46,29 @@ typedef struct proc {
         struct vmmap   *p_vmmap;         /* list of areas mapped into
                                           * process' user address
                                           * space */
+
+        /* The fields above are laid out as the prebuilt libraries
+         * expect, anything new goes below */
+        list_link_t     p_hash_link;     /* link on the pid table, until reaped */
+        int             p_nice;          /* highest run queue level of our threads */
+        uint32_t        p_runtime;       /* sum of our threads' kt_runtime, exited threads included */
+        uint32_t        p_waittime;      /* sum of our threads' kt_waittime */
+        uint32_t        p_nvcsw;         /* sum of our threads' kt_nvcsw */
+        uint32_t        p_nivcsw;        /* sum of our threads' kt_nivcsw */
+        uint32_t        p_minflt;        /* page faults needing no I/O */
+        uint32_t        p_majflt;        /* page faults which read pages in */
+        uint32_t        p_cowflt;        /* pages copied on write for us */
+        uint32_t        p_inblock;       /* file pages read in while we ran */
+        uint32_t        p_oublock;       /* file pages written back while we ran */
+        uint32_t        p_nsyscall;      /* system calls made */
+        struct rusage   p_cru;           /* totals of our reaped children */
+        struct proc    *p_vforkparent;   /* after vfork, the parent whose
+                                          * address space we borrow until
+                                          * we exec or exit */
+        pagedir_t      *p_vforkpagedir;  /* our own page directory meanwhile */
+#ifdef __MTP__
+        int             p_nexttid;       /* the id of the next thread created in us */
+#endif
 } proc_t;
 
 /* Process states. */
@@ -129,6 +154,56 @@ pid_t do_waitpid(pid_t pid, int options, int *status);
  */
 int do_fork(struct regs *regs);
 
+/**
+ * Gives a newly created child of the current process references to the
+ * current process's open files and working directory.
+ *
+ * @param child the child
+ */
+void proc_inherit_files(proc_t *child);
+
+/**
+ * This function implements vfork(2). The child runs in the parent's
+ * address space, and the calling thread sleeps until the child has
+ * exec'd or exited, after which the child has an address space of its
+ * own and the parent its own back.
+ *
+ * @param regs the register state at the time of the system call
+ * @return the pid of the child, or -errno
+ */
+int do_vfork(struct regs *regs);
+
+/**
+ * Gives a process which was created by vfork(2) and has not yet
+ * exec'd or exited its own (empty) address space back, and wakes up
+ * its parent. Does nothing for any other process.
+ *
+ * @param p the process
+ */
+void proc_vfork_release(proc_t *p);
+
+#ifdef __MTP__
+/**
+ * Creates a new thread in the current process which will start
+ * executing in userland with the given registers once it is made
+ * runnable.
+ *
+ * @param regs the registers the thread enters userland with
+ * @return the new thread, or NULL if it could not be created
+ */
+kthread_t *do_thr_create(const struct regs *regs);
+#endif
+
+/**
+ * Reports the resource usage of the current process, or the totals of
+ * the children it has reaped, along with their own children's.
+ *
+ * @param who RUSAGE_SELF or RUSAGE_CHILDREN
+ * @param ru filled in with the usage
+ * @return 0 on success, or -EINVAL if who is neither
+ */
+int proc_getrusage(int who, struct rusage *ru);
+
 /**
  * Provides detailed debug information about a given process.
  *
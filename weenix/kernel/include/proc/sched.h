@@ -1,8 +1,11 @@
 #pragma once
 
+#include "types.h"
+
 #include "util/list.h"
 
 struct kthread;
+struct proc;
 typedef struct ktqueue {
         list_t          tq_list;
         int             tq_size;
@@ -52,9 +55,56 @@ void sched_sleep_on(ktqueue_t *q);
  */
 int sched_cancellable_sleep_on(ktqueue_t *q);
 
+/**
+ * Causes the current thread to enter into an uncancellable sleep on
+ * the given queue which ends after at most the given number of clock
+ * ticks.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the maximum number of clock ticks to sleep for
+ * @return -ETIMEDOUT if the sleep timed out and 0 otherwise
+ */
+int sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
+/**
+ * Causes the current thread to enter into a cancellable sleep on the
+ * given queue which ends after at most the given number of clock
+ * ticks.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the maximum number of clock ticks to sleep for
+ * @return -EINTR if the thread was cancelled, -ETIMEDOUT if the sleep
+ * timed out and 0 otherwise
+ */
+int sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
+/**
+ * Causes the current thread to enter into an exclusive uncancellable
+ * sleep on the given queue, waiting for some amount of a resource.
+ * Exclusive sleepers are only woken a few at a time by
+ * sched_wakeup_n() and sched_wakeup_avail(), so whoever wakes up and
+ * does not use the resource should pass the wakeup on.
+ *
+ * @param q the queue to sleep on
+ * @param want how many units of the resource the thread is after, at
+ * least 1
+ */
+void sched_sleep_on_excl(ktqueue_t *q, uint32_t want);
+
+/**
+ * Causes the current thread to enter into an exclusive cancellable
+ * sleep on the given queue. See sched_sleep_on_excl().
+ *
+ * @param q the queue to sleep on
+ * @param want how many units of the resource the thread is after, at
+ * least 1
+ * @return -EINTR if the thread was cancelled and 0 otherwise
+ */
+int sched_cancellable_sleep_on_excl(ktqueue_t *q, uint32_t want);
+
 /**
  * Wakes a single thread from sleep if there are any waiting on the
- * queue.
+ * queue, the one which has waited longest, exclusive or not.
  *
  * @param q the q to wakeup a thread from
  * @return NULL if q is empty and a thread waiting on the q otherwise
@@ -62,12 +112,76 @@ int sched_cancellable_sleep_on(ktqueue_t *q);
 struct kthread *sched_wakeup_on(ktqueue_t *q);
 
 /**
- * Wake up all threads running on the queue.
+ * Wakes every non-exclusive sleeper on the queue and up to n exclusive
+ * ones, longest waiting first.
+ *
+ * @param q the queue to wake up threads from
+ * @param n the most exclusive sleepers to wake
+ * @return the number of threads woken
+ */
+int sched_wakeup_n(ktqueue_t *q, int n);
+
+/**
+ * Wakes every non-exclusive sleeper on the queue, and exclusive
+ * sleepers, longest waiting first, for as long as the amount of the
+ * resource which is available covers what they want. The longest
+ * waiting exclusive sleeper is woken even if it is not covered, so
+ * that the resource running short is always noticed by someone.
+ *
+ * @param q the queue to wake up threads from
+ * @param avail how many units of the resource are available
+ * @return the number of threads woken
+ */
+int sched_wakeup_avail(ktqueue_t *q, uint32_t avail);
+
+/**
+ * Wake up all threads running on the queue, exclusive or not.
  *
  * @param q the queue to wake up threads from
  */
 void sched_broadcast_on(ktqueue_t *q);
 
+/**
+ * Charges the current thread one clock tick of its time slice. Called
+ * from the clock interrupt handler, so it never switches threads
+ * itself; it only marks the thread for preemption once its quantum is
+ * used up.
+ */
+void sched_tick(void);
+
+/**
+ * Gives up the processor if the current thread has used up its time
+ * slice. Only called on the way back out to userland, the kernel
+ * itself is not preemptible.
+ */
+void sched_preempt(void);
+
+/**
+ * Lowers (or, with a negative increment, raises) the scheduling
+ * priority of every thread in a process. The nice value is the highest
+ * run queue level the process's threads can reach, and is clamped to
+ * [0, SCHED_NPRIO - 1]. Only init and kernel processes may pass a
+ * negative increment.
+ *
+ * @param p the process to change
+ * @param incr the amount to add to the process's nice value
+ * @return the new nice value, or -EPERM if incr is negative and the
+ * current process may not raise priorities
+ */
+int sched_nice(struct proc *p, int incr);
+
+/**
+ * Provides the scheduler statistics of every process, along with a
+ * histogram of how long threads waited on the run queue before they
+ * were run.
+ *
+ * @param arg unused
+ * @param buf the buffer to print into
+ * @param osize the size of buf
+ * @return the number of bytes of buf left unused
+ */
+size_t sched_info(const void *arg, char *buf, size_t osize);
+
 /**
  * Cancel the given thread from the queue it sleeps on.
  *
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "types.h"
+
+#include "util/list.h"
+#include "util/timer.h"
+
+/*
+ * Deferred work. Interrupt handlers should do as little as possible
+ * with interrupts masked: acknowledge the device, grab whatever data
+ * will not survive until later, and schedule a work item. Work items
+ * are run one at a time, in the order they were scheduled, by the
+ * "workd" kernel thread. A work function therefore runs in thread
+ * context with interrupts enabled, and is free to block.
+ */
+
+typedef void (*work_func_t)(void *arg);
+
+typedef struct work {
+        list_link_t     w_link;         /* link on the pending list */
+        work_func_t     w_func;         /* called by workd */
+        void           *w_arg;          /* argument to w_func */
+        int             w_pending;      /* on the pending list */
+        ktimer_t        w_timer;        /* for delayed and periodic work */
+        uint32_t        w_period;       /* re-arm interval in ticks, or 0 */
+} work_t;
+
+/**
+ * Initializes a work item. The item is idle until it is scheduled.
+ *
+ * @param w the work item to initialize
+ * @param func the function workd should call
+ * @param arg the argument to pass to func
+ */
+void work_init(work_t *w, work_func_t func, void *arg);
+
+/**
+ * Queues a work item to be run by workd. This may be called from
+ * interrupt context. A work item which is already queued is not
+ * queued again, so however many times it is scheduled before workd
+ * gets to it, its function is called once.
+ *
+ * @param w the work item to queue
+ * @return 1 if the item was queued and 0 if it was already pending
+ */
+int work_schedule(work_t *w);
+
+/**
+ * Queues a work item after the given number of clock ticks. The item
+ * must not already have a delayed or periodic schedule outstanding.
+ *
+ * @param w the work item to queue
+ * @param ticks the delay, 0 queues the item immediately
+ */
+void work_schedule_delayed(work_t *w, uint32_t ticks);
+
+/**
+ * Queues a work item every given number of clock ticks until it is
+ * cancelled.
+ *
+ * @param w the work item to queue
+ * @param ticks the period, which is rounded up to one tick
+ */
+void work_schedule_periodic(work_t *w, uint32_t ticks);
+
+/**
+ * Removes a work item from the pending list and stops its delayed or
+ * periodic schedule. This does not wait for a call to the item's
+ * function which workd has already started.
+ *
+ * @param w the work item to cancel
+ * @return 1 if the item was queued or had a schedule outstanding,
+ * and 0 otherwise
+ */
+int work_cancel(work_t *w);
+
+/**
+ * Runs any work which is still queued, then stops workd and waits for
+ * it. Called from the idle process during shutdown.
+ */
+void workq_shutdown(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+/*
+ * In-kernel tests of the futexes, reader-writer locks, timer wheel and
+ * pid allocator, run from the kshell's kerntest command. The results
+ * are printed to the DBG_TEST debug output.
+ */
+int kerntest_main(int argc, char **argv);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "types.h"
+
+/* Number of clock interrupts since the clock was started. Each
+ * tick is TICK_MSECS milliseconds long (see config.h). */
+extern volatile uint32_t time_ticks;
+
+/* Converts between milliseconds and clock ticks, rounding up so
+ * that a non-zero interval is never shorter than requested. */
+#define MSECS_TO_TICKS(ms) (((ms) + TICK_MSECS - 1) / TICK_MSECS)
+#define TICKS_TO_MSECS(t)  ((t) * TICK_MSECS)
+
+/* Returns the number of nanoseconds since the clock was started,
+ * read from the time stamp counter. This is cheap enough to call on
+ * any path and, unlike time_ticks, has sub-tick resolution. */
+uint64_t time_nsecs(void);
+
+/* Called by the scheduler with interrupts masked just before the
+ * processor halts for lack of anything to run, and again once it
+ * wakes up. With TICKLESS these stop the clock interrupt until the
+ * next pending timer and then catch time_ticks up; otherwise they do
+ * nothing. */
+void time_idle_start(void);
+void time_idle_stop(void);
+
+/* Reads the processor's time stamp counter */
+static inline uint64_t rdtsc(void)
+{
+        uint64_t tsc;
+        __asm__ volatile("rdtsc" : "=A"(tsc));
+        return tsc;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "types.h"
+
+#include "util/list.h"
+
+/*
+ * One-shot kernel timers, kept in a hierarchical timer wheel which is
+ * advanced by the clock interrupt. Timer functions are called from
+ * interrupt context, so they must not block.
+ */
+
+typedef void (*ktimer_func_t)(void *arg);
+
+typedef struct ktimer {
+        list_link_t     kt_link;        /* link on its wheel slot */
+        uint32_t        kt_expires;     /* the tick at which the timer fires */
+        ktimer_func_t   kt_func;        /* called when the timer fires */
+        void           *kt_arg;         /* argument to kt_func */
+} ktimer_t;
+
+/**
+ * Initializes a timer. The timer is not pending until it is added.
+ *
+ * @param t the timer to initialize
+ * @param func the function to call when the timer fires
+ * @param arg the argument to pass to func
+ */
+void ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg);
+
+/**
+ * Arms a timer to fire after the given number of clock ticks. The
+ * timer must not already be pending.
+ *
+ * @param t the timer to arm
+ * @param ticks the number of clock ticks from now to fire after, a
+ * timer added with 0 ticks fires on the next tick
+ */
+void ktimer_add(ktimer_t *t, uint32_t ticks);
+
+/**
+ * Disarms a timer. It is safe to call this on a timer which has
+ * already fired or was never added.
+ *
+ * @param t the timer to disarm
+ * @return 1 if the timer was pending and 0 otherwise
+ */
+int ktimer_del(ktimer_t *t);
+
+/**
+ * Returns true if the timer has been added and has not fired or been
+ * deleted since.
+ */
+int ktimer_pending(ktimer_t *t);
+
+/**
+ * Returns the earliest tick at which ktimer_run might have a timer to
+ * fire. The answer is never later than the tick on which the first
+ * level of the wheel next wraps around. Must be called with
+ * interrupts masked.
+ */
+uint32_t ktimer_next_expiry(void);
+
+/**
+ * Fires every timer which has expired as of the current tick. Only
+ * the clock interrupt handler should call this.
+ */
+void ktimer_run(void);
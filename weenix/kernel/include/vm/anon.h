@@ -5,5 +5,11 @@ struct mmobj;
 void anon_init();
 struct mmobj *anon_create(void);
 
+/* Zeroes a page into the pool anon_fillpage takes its pages from.
+ * Called by the scheduler when it has nothing to run; returns
+ * nonzero if it did any work, and 0 if the pool is full or there
+ * is no memory to spare. Never blocks. */
+int anon_zero_idle(void);
+
 extern int anon_count;
 
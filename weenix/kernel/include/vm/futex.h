@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+
+/*
+ * Fast user-space locking. A futex is any aligned int in user memory;
+ * user space manipulates it with atomic instructions and only enters
+ * the kernel to sleep while it holds a particular value, or to wake
+ * threads sleeping on it.
+ *
+ * Sleepers are queued by where the int lives rather than by its
+ * virtual address. In a MAP_SHARED mapping that is the mmobj and the
+ * offset within it, so processes which map the same object at
+ * different addresses still find each other. Private memory can only
+ * be shared by the threads of one process, so there the key is simply
+ * the address space and the address.
+ */
+
+/**
+ * Puts the current thread to sleep on the futex at uaddr, provided it
+ * still holds the value expected. Checking the value and going to
+ * sleep cannot be separated by a wakeup, so a thread which changes
+ * the value and then calls futex_wake can never be missed.
+ *
+ * @param uaddr the futex, which must be 4-byte aligned
+ * @param expected the value the caller last saw at uaddr
+ * @return 0 when woken, -EWOULDBLOCK if *uaddr != expected, -EINTR if
+ * the thread was cancelled, -EINVAL if uaddr is not aligned, -EFAULT if
+ * it is not mapped, or -ENOMEM
+ */
+int futex_wait(int *uaddr, int expected);
+
+/**
+ * Wakes up to n threads sleeping on the futex at uaddr, oldest first.
+ *
+ * @param uaddr the futex, which must be 4-byte aligned
+ * @param n the most threads to wake
+ * @return the number of threads woken, -EINVAL if uaddr is not
+ * aligned, or -EFAULT if it is not mapped
+ */
+int futex_wake(int *uaddr, int n);
@@ -160,23 +160,28 @@ void apic_init()
         KASSERT(PAGE_ALIGNED(apic->at_addr));
         apic->at_addr = pt_phys_perm_map(apic->at_addr, 1);
 
-        /* Get the tables for the local APIC and IO APICS,
-         * Weenix currently only supports one of each, in order
-         * to enforce this a KASSERT will fail this if more than one
-         * of each type is found */
+        /* Get the tables for the local APICs and IO APICS. There is
+         * one local APIC per processor; Weenix only runs on the one
+         * we are running on, the BSP's, and leaves the others halted.
+         * Weenix currently only supports one IO APIC, in order to
+         * enforce this a KASSERT will fail if more than one is found */
         uint8_t off = sizeof(*apic);
         while (off < apic->at_header.ah_size) {
                 uint8_t type = *(ptr + off);
                 uint8_t size = *(ptr + off + 1);
                 if (TYPE_LAPIC == type) {
+                        struct lapic_table *l = (struct lapic_table *)(ptr + off);
                         KASSERT(sizeof(struct lapic_table) == size);
-                        KASSERT(NULL == lapic && "Weenix only supports a single local APIC");
-                        lapic = (struct lapic_table *)(ptr + off);
                         dbgq(DBG_CORE, "LAPIC:\n");
-                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)lapic->at_apicid);
-                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)lapic->at_procid);
-                        dbgq(DBG_CORE, "   enabled:    %i\n", lapic->at_flags & 0x1);
-                        KASSERT(lapic->at_flags & 0x1 && "The local APIC is disabled");
+                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)l->at_apicid);
+                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)l->at_procid);
+                        dbgq(DBG_CORE, "   enabled:    %i\n", l->at_flags & 0x1);
+                        if (l->at_apicid == __lapic_getid()) {
+                                KASSERT(l->at_flags & 0x1 && "The local APIC is disabled");
+                                lapic = l;
+                        } else {
+                                dbgq(DBG_CORE, "   not the BSP, left halted\n");
+                        }
                 } else if (TYPE_IOAPIC == type) {
                         KASSERT(sizeof(struct ioapic_table) == size);
                         KASSERT(NULL == ioapic && "Weenix only supports a single IO APIC");
@@ -0,0 +1,196 @@
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "main/fpu.h"
+
+#include "mm/slab.h"
+
+#include "proc/kthread.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/string.h"
+
+#define CR0_MP (1 << 1)         /* WAIT honours TS */
+#define CR0_EM (1 << 2)         /* FPU instructions always trap */
+#define CR0_TS (1 << 3)         /* next FPU instruction traps */
+#define CR0_NE (1 << 5)         /* native FPU error reporting */
+
+#define CR4_OSFXSR     (1 << 9)         /* FXSAVE saves SSE state */
+#define CR4_OSXMMEXCPT (1 << 10)        /* SSE exceptions raise #XM */
+
+#define CPUID_FXSR (1 << 24)
+#define CPUID_SSE  (1 << 25)
+
+/* The default MXCSR, all SSE exceptions masked */
+#define MXCSR_INIT 0x1f80
+
+/* The 16-byte aligned FXSAVE area within an allocated FPU state */
+#define FPU_AREA(state) ((void *)(((uintptr_t)(state) + 15) & ~(uintptr_t)15))
+
+static inline uint32_t
+read_cr0(void)
+{
+        uint32_t cr0;
+        __asm__ volatile("movl %%cr0, %0" : "=r"(cr0));
+        return cr0;
+}
+
+static inline void
+write_cr0(uint32_t cr0)
+{
+        __asm__ volatile("movl %0, %%cr0" :: "r"(cr0));
+}
+
+static inline uint32_t
+read_cr4(void)
+{
+        uint32_t cr4;
+        __asm__ volatile("movl %%cr4, %0" : "=r"(cr4));
+        return cr4;
+}
+
+static inline void
+write_cr4(uint32_t cr4)
+{
+        __asm__ volatile("movl %0, %%cr4" :: "r"(cr4));
+}
+
+static inline void
+fxsave(void *area)
+{
+        __asm__ volatile("fxsave (%0)" :: "r"(area) : "memory");
+}
+
+static inline void
+fxrstor(void *area)
+{
+        __asm__ volatile("fxrstor (%0)" :: "r"(area) : "memory");
+}
+
+static struct slab_allocator *fpu_allocator = NULL;
+
+/* Whether the processor can FXSAVE, without which the FPU stays off */
+static int fpu_present = 0;
+
+/* The thread whose state is in the FPU registers, if any */
+static kthread_t *fpu_owner = NULL;
+
+/* What a thread's FPU looks like the first time it uses it */
+static uint8_t fpu_initstate[512] __attribute__((aligned(16)));
+
+static __attribute__((unused)) void
+fpu_init(void)
+{
+        uint32_t eax, ebx, ecx, edx;
+        uint32_t cr0;
+
+        __asm__ volatile("cpuid"
+                         : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                         : "a"(1));
+
+        cr0 = read_cr0() | CR0_NE;
+        if (!(edx & CPUID_FXSR)) {
+                dbg(DBG_CORE, "no FXSAVE support, user FPU use is disabled\n");
+                write_cr0(cr0 | CR0_EM);
+                return;
+        }
+        write_cr0((cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP);
+        if (edx & CPUID_SSE)
+                write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+
+        /* The SSE registers are still clear from reset, so this saves
+         * a state which leaks nothing between threads */
+        __asm__ volatile("fninit");
+        if (edx & CPUID_SSE) {
+                uint32_t mxcsr = MXCSR_INIT;
+                __asm__ volatile("ldmxcsr %0" :: "m"(mxcsr));
+        }
+        fxsave(fpu_initstate);
+
+        fpu_allocator = slab_allocator_create("fpu", FPU_STATE_SIZE);
+        KASSERT(NULL != fpu_allocator);
+
+        write_cr0(read_cr0() | CR0_TS);
+        fpu_present = 1;
+        dbg(DBG_CORE, "lazy FPU switching enabled%s\n",
+            (edx & CPUID_SSE) ? " with SSE" : "");
+}
+init_func(fpu_init);
+
+void
+fpu_switch(kthread_t *thr)
+{
+        uint32_t cr0;
+
+        if (!fpu_present)
+                return;
+
+        cr0 = read_cr0();
+        if (thr == fpu_owner) {
+                if (cr0 & CR0_TS)
+                        __asm__ volatile("clts");
+        } else if (!(cr0 & CR0_TS)) {
+                write_cr0(cr0 | CR0_TS);
+        }
+}
+
+int
+fpu_trap(void)
+{
+        if (!fpu_present)
+                return -ENOSYS;
+
+        if (NULL == curthr->kt_fpu) {
+                curthr->kt_fpu = slab_obj_alloc(fpu_allocator);
+                if (NULL == curthr->kt_fpu)
+                        return -ENOMEM;
+                memcpy(FPU_AREA(curthr->kt_fpu), fpu_initstate,
+                       sizeof(fpu_initstate));
+        }
+
+        __asm__ volatile("clts");
+        if (curthr == fpu_owner)
+                return 0;
+        if (NULL != fpu_owner)
+                fxsave(FPU_AREA(fpu_owner->kt_fpu));
+        fxrstor(FPU_AREA(curthr->kt_fpu));
+        fpu_owner = curthr;
+        return 0;
+}
+
+void
+fpu_clone(kthread_t *old, kthread_t *new)
+{
+        KASSERT(old == curthr);
+
+        new->kt_fpu = NULL;
+        if (NULL == old->kt_fpu)
+                return;
+        if (NULL == (new->kt_fpu = slab_obj_alloc(fpu_allocator))) {
+                dbg(DBG_CORE, "no memory to copy FPU state of thread %p\n", old);
+                return;
+        }
+
+        /* The live copy is in the registers, not in old's area */
+        if (old == fpu_owner)
+                fxsave(FPU_AREA(old->kt_fpu));
+        memcpy(FPU_AREA(new->kt_fpu), FPU_AREA(old->kt_fpu),
+               sizeof(fpu_initstate));
+}
+
+void
+fpu_release(kthread_t *thr)
+{
+        /* If thr is running, its next FPU instruction must trap rather
+         * than find its old registers */
+        if (thr == fpu_owner) {
+                fpu_owner = NULL;
+                write_cr0(read_cr0() | CR0_TS);
+        }
+        if (NULL != thr->kt_fpu) {
+                slab_obj_free(fpu_allocator, thr->kt_fpu);
+                thr->kt_fpu = NULL;
+        }
+}
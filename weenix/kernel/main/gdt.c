@@ -1,5 +1,9 @@
+#include "globals.h"
+
 #include "main/gdt.h"
 
+#include "mm/page.h"
+
 #include "util/printf.h"
 #include "util/debug.h"
 #include "util/string.h"
@@ -49,11 +53,40 @@ struct gdt_location {
 
 static struct gdt_entry gdt[GDT_COUNT];
 static struct tss_entry tss;
+
+/*
+ * Double faults are handled by a task switch to df_tss, which has its
+ * own stack. A kernel stack overflow faults while pushing onto the
+ * guard page, and delivering the page fault needs that same stack, so
+ * the double fault is the only place it can be caught.
+ */
+static struct tss_entry df_tss;
+static char df_stack[PAGE_SIZE] __attribute__((aligned(16)));
 static struct gdt_location gdtl = {
         .gl_size = GDT_COUNT * 8,
         .gl_offset = (uint32_t) &gdt
 };
 
+static void gdt_double_fault(void)
+{
+        /* The task switch saved the faulting context in the main TSS.
+         * If delivering a fault could not push its (at most 16 byte)
+         * frame without hitting the guard page, the stack overflowed. */
+        if (NULL != curthr && kthread_stack_guarded(curthr, tss.ts_esp - 16)) {
+                panic("\nKernel stack overflow in thread 0x%p of process %d at eip=0x%08x\n",
+                      curthr, curproc->p_pid, tss.ts_eip);
+        }
+        panic("\nDouble fault at eip=0x%08x esp=0x%08x\n", tss.ts_eip, tss.ts_esp);
+}
+
+static void gdt_set_tss(uint32_t segment, struct tss_entry *t)
+{
+        gdt_set_entry(segment, (uint32_t)t, sizeof(*t), 0, 1, 0, 0);
+        gdt[segment / 8].ge_access &= ~(0b10000);
+        gdt[segment / 8].ge_access |= 0b1;
+        gdt[segment / 8].ge_flags &= ~(0b10000000);
+}
+
 void gdt_init(void)
 {
         struct gdt_location *data = &gdtl;
@@ -67,15 +100,24 @@ void gdt_init(void)
 
         __asm__ volatile("lgdt (%0)" :: "p"(data));
 
-        gdt_set_entry(GDT_TSS, (uint32_t)&tss, sizeof(tss), 0, 1, 0, 0);
-        gdt[GDT_TSS / 8].ge_access &= ~(0b10000);
-        gdt[GDT_TSS / 8].ge_access |= 0b1;
-        gdt[GDT_TSS / 8].ge_flags &= ~(0b10000000);
+        gdt_set_tss(GDT_TSS, &tss);
 
         memset(&tss, 0, sizeof(tss));
         tss.ts_ss0 = GDT_KERNEL_DATA;
         tss.ts_iopb = sizeof(tss);
 
+        gdt_set_tss(GDT_DF_TSS, &df_tss);
+
+        memset(&df_tss, 0, sizeof(df_tss));
+        __asm__ volatile("movl %%cr3, %0" : "=r"(df_tss.ts_cr3));
+        df_tss.ts_eip = (uint32_t)gdt_double_fault;
+        df_tss.ts_eflags = 0x2; /* interrupts disabled */
+        df_tss.ts_esp = (uint32_t)df_stack + sizeof(df_stack);
+        df_tss.ts_cs = GDT_KERNEL_TEXT;
+        df_tss.ts_ds = df_tss.ts_es = df_tss.ts_ss = GDT_KERNEL_DATA;
+        df_tss.ts_fs = df_tss.ts_gd = GDT_KERNEL_DATA;
+        df_tss.ts_iopb = sizeof(df_tss);
+
         int segment = GDT_TSS;
         __asm__ volatile("ltr %0" :: "m"(segment));
 }
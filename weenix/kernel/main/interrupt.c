@@ -1,4 +1,6 @@
 #include "types.h"
+#include "globals.h"
+#include "errno.h"
 
 #include "util/debug.h"
 #include "util/string.h"
@@ -7,6 +9,10 @@
 #include "main/apic.h"
 #include "main/interrupt.h"
 #include "main/gdt.h"
+#include "main/fpu.h"
+
+#include "proc/proc.h"
+#include "proc/sched.h"
 
 #define MAX_INTERRUPTS          256
 
@@ -15,6 +21,7 @@
 /* Convenient definitions for intr_desc.attr */
 
 #define IDT_DESC_TRAP           0x01
+#define IDT_DESC_TASK           0x05
 #define IDT_DESC_BIT16          0x06
 #define IDT_DESC_BIT32          0x0E
 #define IDT_DESC_RING0          0x00
@@ -384,6 +391,23 @@ static __attribute__((used)) void __intr_handler(regs_t regs)
         }
 
         _intr_regs = NULL;
+
+#ifdef __UPREEMPT__
+        /* The kernel itself is not preemptible, a thread can only be
+         * forced off the processor on its way back out to userland */
+        if (0x3 == (regs.r_cs & 0x3)) {
+                sched_preempt();
+        }
+#endif
+
+#ifdef __MTP__
+        /* A thread cancelled while it was running in userland, e.g.
+         * because another thread of its process called exit, only
+         * finds out on its way back there */
+        if (0x3 == (regs.r_cs & 0x3) && curthr->kt_cancelled) {
+                kthread_exit(curthr->kt_retval);
+        }
+#endif
 }
 
 static void __intr_divide_by_zero_handler(regs_t *regs)
@@ -396,14 +420,33 @@ static void __intr_gpf_handler(regs_t *regs)
         panic("\nGeneral Protection Fault:\nError: 0x%.8x\n", regs->r_err);
 }
 
-static void __intr_timer_handler(regs_t *regs)
+static void __intr_inval_opcode_handler(regs_t *regs)
 {
-        panic("\nTimer Interrupt:\nError: 0x%.8x\n", regs->r_err);
+        panic("\nInvalid opcode error at eip=0x%08x\n", regs->r_eip);
 }
 
-static void __intr_inval_opcode_handler(regs_t *regs)
+/* Only user threads use the FPU, see fpu.h */
+static void __intr_fpu_unavailable_handler(regs_t *regs)
 {
-        panic("\nInvalid opcode error at eip=0x%08x\n", regs->r_eip);
+        int err;
+
+        if (0x3 != (regs->r_cs & 0x3))
+                panic("\nFPU used by the kernel at eip=0x%08x\n", regs->r_eip);
+        if (0 > (err = fpu_trap())) {
+                dbg(DBG_CORE, "no FPU for proc %d: %d\n", curproc->p_pid, err);
+                proc_kill(curproc, err);
+        }
+}
+
+/* Unmasked x87 and SSE floating point exceptions */
+static void __intr_fpu_error_handler(regs_t *regs)
+{
+        if (0x3 != (regs->r_cs & 0x3))
+                panic("\nFloating point exception in the kernel at eip=0x%08x\n",
+                      regs->r_eip);
+        dbg(DBG_CORE, "floating point exception in proc %d at eip=0x%08x\n",
+            curproc->p_pid, regs->r_eip);
+        proc_kill(curproc, -EFAULT);
 }
 
 static void __intr_spurious(regs_t *regs)
@@ -442,7 +485,8 @@ void intr_init()
         __intr_set_entry(5,   (uint32_t)&INTR(5),   GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
         __intr_set_entry(6,   (uint32_t)&INTR(6),   GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
         __intr_set_entry(7,   (uint32_t)&INTR(7),   GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
-        __intr_set_entry(8,   (uint32_t)&INTR(8),   GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
+        /* double faults switch to their own task and stack, see gdt.c */
+        __intr_set_entry(8,   0,                    GDT_DF_TSS,      IDT_DESC_PRESENT | IDT_DESC_TASK | IDT_DESC_RING0);
         __intr_set_entry(9,   (uint32_t)&INTR(9),   GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
         __intr_set_entry(10,  (uint32_t)&INTR(10),  GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
         __intr_set_entry(11,  (uint32_t)&INTR(11),  GDT_KERNEL_TEXT, IDT_DESC_PRESENT | IDT_DESC_BIT32 | IDT_DESC_RING0);
@@ -702,4 +746,7 @@ void intr_init()
         intr_register(INTR_DIVIDE_BY_ZERO, __intr_divide_by_zero_handler);
         intr_register(INTR_GPF, __intr_gpf_handler);
         intr_register(INTR_INVALID_OPCODE, __intr_inval_opcode_handler);
+        intr_register(INTR_DEVICE_NOT_AVAILABLE, __intr_fpu_unavailable_handler);
+        intr_register(INTR_FPU_ERROR, __intr_fpu_error_handler);
+        intr_register(INTR_SIMD_ERROR, __intr_fpu_error_handler);
 }
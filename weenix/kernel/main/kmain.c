@@ -36,6 +36,8 @@
 #include "proc/sched.h"
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/kmutex.h"
+#include "proc/workq.h"
 
 #include "drivers/dev.h"
 #include "drivers/blockdev.h"
@@ -244,6 +246,9 @@ idleproc_run(int arg1, void *arg2)
         child = do_waitpid(-1, 0, &status);
         KASSERT(PID_INIT == child);
 
+        /* Finish any deferred work and stop workd */
+        workq_shutdown();
+
 #ifdef __MTP__
         kthread_reapd_shutdown();
 #endif
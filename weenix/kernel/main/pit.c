@@ -1,5 +1,8 @@
+#include "config.h"
+
 #include "main/io.h"
 #include "main/interrupt.h"
+#include "util/debug.h"
 #include "util/delay.h"
 
 /* IRQ */
@@ -11,9 +14,15 @@
 #define PIT_DATA2 0x42
 #define PIT_CMD   0x43
 
+/* Channel 2 gate and output, shared with the PC speaker */
+#define PIT_GATE2 0x61
+#define GATE2_ENABLE  0x01
+#define GATE2_SPEAKER 0x02
+#define GATE2_OUT     0x20
+
 #define CLOCK_TICK_RATE 1193182
 #undef HZ
-#define HZ 1000
+#define HZ (1000 / TICK_MSECS)
 
 #define LATCH (CLOCK_TICK_RATE / HZ)
 
@@ -22,9 +31,30 @@ void pit_starttimer(uint8_t intr)
         intr_map(PIT_IRQ, intr);
 
         /* Shamelessly cribbed from "Understanding the Linux Kernel", pp 230 */
-        outb(0x34, PIT_CMD);
+        outb(PIT_CMD, 0x34);
         udelay(10);
-        outb(LATCH & 0xff, PIT_DATA0);
+        outb(PIT_DATA0, LATCH & 0xff);
         udelay(10);
-        outb(LATCH >> 8, PIT_DATA0);
+        outb(PIT_DATA0, LATCH >> 8);
+}
+
+void pit_busywait(uint32_t msecs)
+{
+        uint32_t count = (CLOCK_TICK_RATE / 1000) * msecs;
+        uint8_t gate;
+
+        KASSERT(count <= 0xffff && "PIT busy wait too long");
+
+        /* Channel 2 is not wired to an IRQ, so it is free to be used in
+         * mode 0 (interrupt on terminal count), whose output we poll */
+        gate = inb(PIT_GATE2) & ~(GATE2_ENABLE | GATE2_SPEAKER);
+        outb(PIT_GATE2, gate);
+        outb(PIT_CMD, 0xb0);
+        outb(PIT_DATA2, count & 0xff);
+        outb(PIT_DATA2, count >> 8);
+
+        /* The count starts when the gate goes high */
+        outb(PIT_GATE2, gate | GATE2_ENABLE);
+        while (!(inb(PIT_GATE2) & GATE2_OUT));
+        outb(PIT_GATE2, gate);
 }
@@ -7,6 +7,7 @@
 
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/sched.h"
 
 #include "mm/mm.h"
 #include "mm/mman.h"
@@ -26,6 +27,8 @@
 
 #include "main/interrupt.h"
 
+#define PT_ENTRY_COUNT (PAGE_SIZE / sizeof(pte_t))
+
 /* Pushes the appropriate things onto the kernel stack of a newly forked thread
  * so that it can begin execution in userland_entry.
  * regs: registers the new thread should have on execution
@@ -36,18 +39,146 @@ fork_setup_stack(const regs_t *regs, void *kstack)
 {
         /* Pointer argument and dummy return address, and userland dummy return
          * address */
-        uint32_t esp = ((uint32_t) kstack) + DEFAULT_STACK_SIZE - (sizeof(regs_t) + 12);
+        uint32_t esp = ((uint32_t) kstack) + KSTACK_SIZE - (sizeof(regs_t) + 12);
         *(void **)(esp + 4) = (void *)(esp + 8); /* Set the argument to point to location of struct on stack */
         memcpy((void *)(esp + 8), regs, sizeof(regs_t)); /* Copy over struct */
         return esp;
 }
 
 
+#ifdef __MTP__
+/*
+ * Creates a new thread in the current process which enters userland
+ * with the given registers, in the same way as the child of a fork.
+ * The thread is not made runnable.
+ */
+kthread_t *
+do_thr_create(const struct regs *regs)
+{
+        kthread_t *thr;
+
+        if (NULL == (thr = kthread_create(curproc, NULL, 0, NULL)))
+                return NULL;
+        thr->kt_ctx.c_eip = (uint32_t) userland_entry;
+        thr->kt_ctx.c_esp = fork_setup_stack(regs, thr->kt_kstack);
+        return thr;
+}
+#endif
+
+/*
+ * Gives each private area of the current process, and the matching
+ * area of its clone, a new shadow object on top of the object the area
+ * had, which from then on is written by neither. Areas of the clone
+ * which are shared get the same object as the parent's.
+ * Returns 0 on success or -ENOMEM, in which case the clone's areas are
+ * left without objects and the parent's are still usable.
+ */
+static int
+fork_shadow_areas(vmmap_t *clone)
+{
+        vmarea_t *pvma, *cvma;
+        list_link_t *clink = clone->vmm_list.l_next;
+
+        list_iterate_begin(&curproc->p_vmmap->vmm_list, pvma, vmarea_t, vma_plink) {
+                mmobj_t *obj = pvma->vma_obj;
+
+                cvma = list_item(clink, vmarea_t, vma_plink);
+                clink = clink->l_next;
+                KASSERT(cvma->vma_start == pvma->vma_start);
+
+                if (MAP_PRIVATE == (pvma->vma_flags & MAP_TYPE)) {
+                        mmobj_t *pshadow, *cshadow;
+
+                        if (NULL == (pshadow = shadow_create()))
+                                goto nomem;
+                        if (NULL == (cshadow = shadow_create())) {
+                                pshadow->mmo_ops->put(pshadow);
+                                goto nomem;
+                        }
+                        /* the parent's reference to obj passes to its
+                         * shadow, the child's shadow takes another */
+                        pshadow->mmo_shadowed = obj;
+                        pshadow->mmo_un.mmo_bottom_obj = mmobj_bottom_obj(obj);
+                        cshadow->mmo_shadowed = obj;
+                        cshadow->mmo_un.mmo_bottom_obj = mmobj_bottom_obj(obj);
+                        obj->mmo_ops->ref(obj);
+                        pvma->vma_obj = pshadow;
+                        cvma->vma_obj = cshadow;
+                } else {
+                        obj->mmo_ops->ref(obj);
+                        cvma->vma_obj = obj;
+                }
+                list_insert_tail(mmobj_bottom_vmas(cvma->vma_obj), &cvma->vma_olink);
+        } list_iterate_end();
+        return 0;
+
+nomem:
+        list_iterate_begin(&clone->vmm_list, cvma, vmarea_t, vma_plink) {
+                if (NULL == cvma->vma_obj)
+                        break;
+                list_remove(&cvma->vma_olink);
+                cvma->vma_obj->mmo_ops->put(cvma->vma_obj);
+                cvma->vma_obj = NULL;
+        } list_iterate_end();
+        return -ENOMEM;
+}
+
+/*
+ * Copies the current process's mappings of the pages in [vlow, vhigh)
+ * into dst. If cow is set each page is first made read-only in the
+ * current process, and so in dst too. The page tables are reached
+ * through the temporary mapping, starting from the physical address of
+ * the page directory (which is what pt_set() loads into cr3), since
+ * pt_map() also uses that mapping the entries are mapped in again
+ * after every call to it. The TLB is not flushed.
+ * Returns 0, or the error from pt_map().
+ */
+static int
+fork_copy_mappings(pagedir_t *dst, uintptr_t vlow, uintptr_t vhigh, int cow)
+{
+        uintptr_t pdphys = pt_virt_to_phys((uintptr_t)curproc->p_pagedir);
+        uintptr_t vaddr = vlow;
+        int err;
+
+        KASSERT(curproc->p_pagedir == pt_get());
+        KASSERT(PAGE_ALIGNED(vlow) && PAGE_ALIGNED(vhigh));
+
+        while (vaddr < vhigh) {
+                uint32_t pdi = ((uint32_t)vaddr >> PAGE_SHIFT) / PT_ENTRY_COUNT;
+                uint32_t pti = ((uint32_t)vaddr >> PAGE_SHIFT) % PT_ENTRY_COUNT;
+                pde_t pde = ((pde_t *)pt_phys_tmp_map(pdphys))[pdi];
+                pte_t *pt, pte;
+
+                if (!(PD_PRESENT & pde)) {
+                        /* nothing is mapped in the rest of this table */
+                        vaddr += (PT_ENTRY_COUNT - pti) * PAGE_SIZE;
+                        continue;
+                }
+                pt = (pte_t *)pt_phys_tmp_map(pde & PAGE_MASK);
+                if (PT_PRESENT & pt[pti]) {
+                        if (cow)
+                                pt[pti] &= ~PT_WRITE;
+                        pte = pt[pti];
+                        if (0 > (err = pt_map(dst, vaddr, pte & PAGE_MASK,
+                                              pde & ~PAGE_MASK, pte & ~PAGE_MASK)))
+                                return err;
+                }
+                vaddr += PAGE_SIZE;
+        }
+        return 0;
+}
+
 /*
  * The implementation of fork(2). Once this works,
  * you're practically home free. This is what the
  * entirety of Weenix has been leading up to.
  * Go forth and conquer.
+ *
+ * Memory is copy-on-write: the parent keeps its pages mapped, and the
+ * child starts with the same mappings, but both lose write access to
+ * every private page, so that only the pages which are written after
+ * the fork are ever copied (by the shadow objects, in the fault
+ * handler).
  */
 int
 do_fork(struct regs *regs)
@@ -64,31 +195,31 @@ do_fork(struct regs *regs)
 		KASSERT (curproc->p_state == PROC_RUNNING);
 		dbg(DBG_USER,"GRADING: I've made it ! May I have 2 points please ! \n");
 
-		proc_t *process = proc_create("process");
-		process->p_vmmap = vmmap_clone(curproc->p_vmmap);
-		vmarea_t *parent_vmarea;
-		list_iterate_begin(&(curproc->p_vmmap->vmm_list), parent_vmarea, vmarea_t, vma_plink)
-		{
-			if (parent_vmarea->vma_flags == MAP_PRIVATE)
-			{
-				mmobj_t *obj = shadow_create();
-				obj = parent_vmarea->vma_obj;
-				parent_vmarea->vma_obj = obj;	
-			}
+		vmmap_t *map = vmmap_clone(curproc->p_vmmap);
+		if (NULL == map)
+			return -ENOMEM;
+		if (0 > fork_shadow_areas(map)) {
+			vmmap_destroy(map);
+			return -ENOMEM;
 		}
-		list_iterate_end();
-		vmarea_t *child_vmarea;
-		list_iterate_begin(&(process->p_vmmap->vmm_list), child_vmarea, vmarea_t, vma_plink)
+
+		proc_t *process = proc_create("process");
+		vmmap_destroy(process->p_vmmap);
+		process->p_vmmap = map;
+		map->vmm_proc = process;
+
+		/* Share the pages which are resident rather than having
+		 * both processes fault them all back in. A page table we
+		 * cannot allocate only means the child faults those. */
+		vmarea_t *vma;
+		list_iterate_begin(&curproc->p_vmmap->vmm_list, vma, vmarea_t, vma_plink)
 		{
-			if (child_vmarea->vma_flags == MAP_PRIVATE)
-			{
-				mmobj_t *obj = shadow_create();
-				obj = parent_vmarea->vma_obj;
-				child_vmarea->vma_obj= obj;
-			}
+			fork_copy_mappings(process->p_pagedir,
+			                   (uintptr_t)PN_TO_ADDR(vma->vma_start),
+			                   (uintptr_t)PN_TO_ADDR(vma->vma_end),
+			                   MAP_PRIVATE == (vma->vma_flags & MAP_TYPE));
 		}
 		list_iterate_end();
-		pt_unmap_range(curproc->p_pagedir, 0, 0);
 		tlb_flush_all();
 
 		kthread_t *child_thread = kthread_create(process, NULL, 0, NULL);
@@ -113,3 +244,44 @@ do_fork(struct regs *regs)
 		process->p_cwd = curproc->p_cwd;
 		return 0;
 }
+
+int
+do_vfork(struct regs *regs)
+{
+        proc_t *child;
+        kthread_t *thr;
+        regs_t cregs;
+        pid_t pid;
+
+        KASSERT(NULL != regs);
+        KASSERT(PROC_RUNNING == curproc->p_state);
+
+        /* The child runs on our map and page directory, so none of
+         * it is copied, and its own stay empty until it execs */
+        child = proc_create(curproc->p_comm);
+        vmmap_destroy(child->p_vmmap);
+        child->p_vmmap = curproc->p_vmmap;
+        child->p_vforkpagedir = child->p_pagedir;
+        child->p_pagedir = curproc->p_pagedir;
+        child->p_vforkparent = curproc;
+        child->p_brk = curproc->p_brk;
+        child->p_start_brk = curproc->p_start_brk;
+        proc_inherit_files(child);
+
+        /* In the child the system call returns 0 */
+        cregs = *regs;
+        cregs.r_eax = 0;
+        thr = kthread_create(child, NULL, 0, NULL);
+        thr->kt_ctx.c_eip = (uint32_t) userland_entry;
+        thr->kt_ctx.c_esp = fork_setup_stack(&cregs, thr->kt_kstack);
+        sched_make_runnable(thr);
+
+        /* Until the child lets go of our address space, we must not
+         * touch it, so this sleep cannot be cancelled. Once the child
+         * has let go, another of our threads may reap it at any time,
+         * so it is only looked at through the pid table. */
+        pid = child->p_pid;
+        while (NULL != (child = proc_lookup(pid)) && curproc == child->p_vforkparent)
+                sched_sleep_on(&curproc->p_wait);
+        return pid;
+}
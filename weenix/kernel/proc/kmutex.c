@@ -6,13 +6,19 @@ void kmutex_lock(kmutex_t *mtx);
 void kmutex_lock_cancellable(kmutex_t *mtx); void kmutex_unlock(kmutex_t *mtx);
 */
 
+#include "config.h"
 #include "globals.h"
 #include "errno.h"
 
 #include "util/debug.h"
+#include "util/printf.h"
+#include "util/time.h"
 
 #include "proc/kthread.h"
 #include "proc/kmutex.h"
+#include "proc/proc.h"
+
+#include "mm/kmalloc.h"
 
 /*
  * IMPORTANT: Mutexes can _NEVER_ be locked or unlocked from an
@@ -20,11 +26,202 @@ void kmutex_lock_cancellable(kmutex_t *mtx); void kmutex_unlock(kmutex_t *mtx);
  * thread context.
  */
 
+#ifdef __MUTEXPROF__
+/* Every class which has had a mutex initialized, never shrinks */
+static list_t kmutex_classes = { &kmutex_classes, &kmutex_classes };
+
+/* Classes for the callers of the kmutex_init function itself rather
+ * than the macro, which includes all of the prebuilt libraries */
+static kmutex_class_t kmutex_site_classes[KMUTEX_PROF_SITES];
+
+/*
+ * The class of each mutex and when its current holder got it, found
+ * by hashing the mutex's address with linear probing. Entries are
+ * never removed, only taken over when a mutex is initialized again at
+ * the same address, so once the table is full any further mutexes go
+ * unaccounted.
+ */
+typedef struct kmutex_prof {
+        kmutex_t       *kp_mtx;
+        kmutex_class_t *kp_class;
+        uint64_t        kp_locked_at;
+} kmutex_prof_t;
+
+static kmutex_prof_t kmutex_prof_table[KMUTEX_PROF_SLOTS];
+static uint32_t kmutex_prof_dropped = 0; /* mutexes the table had no room for */
+
+/* Returns the entry of the given mutex, or if create is set and the
+ * mutex has none, a new one. NULL if there is neither. */
+static kmutex_prof_t *
+kmutex_prof_lookup(kmutex_t *mtx, int create)
+{
+        uint32_t h = ((uintptr_t)mtx >> 2) % KMUTEX_PROF_SLOTS;
+        uint32_t i;
+
+        for (i = 0; i < KMUTEX_PROF_SLOTS; ++i) {
+                kmutex_prof_t *kp = &kmutex_prof_table[(h + i) % KMUTEX_PROF_SLOTS];
+
+                if (mtx == kp->kp_mtx)
+                        return kp;
+                if (NULL == kp->kp_mtx) {
+                        if (!create)
+                                return NULL;
+                        kp->kp_mtx = mtx;
+                        return kp;
+                }
+        }
+        return NULL;
+}
+
+/* Returns the class for mutexes initialized by the given caller of
+ * kmutex_init, or NULL if there are too many callers already */
+static kmutex_class_t *
+kmutex_site_class(uintptr_t site)
+{
+        int i;
+
+        for (i = 0; i < KMUTEX_PROF_SITES; ++i) {
+                kmutex_class_t *cls = &kmutex_site_classes[i];
+
+                if (site == cls->kc_site)
+                        return cls;
+                if (0 == cls->kc_site) {
+                        cls->kc_site = site;
+                        return cls;
+                }
+        }
+        return NULL;
+}
+
+/* Starts accounting the given (just initialized) mutex to cls */
+static void
+kmutex_prof_register(kmutex_t *mtx, kmutex_class_t *cls)
+{
+        kmutex_prof_t *kp;
+
+        if (NULL == (kp = kmutex_prof_lookup(mtx, 1))) {
+                ++kmutex_prof_dropped;
+                return;
+        }
+        kp->kp_class = cls;
+        kp->kp_locked_at = 0;
+        if (NULL != cls && !list_link_is_linked(&cls->kc_link))
+                list_insert_tail(&kmutex_classes, &cls->kc_link);
+}
+
+static void
+kmutex_prof_acquired(kmutex_t *mtx, uint64_t start, int contended)
+{
+        kmutex_prof_t *kp = kmutex_prof_lookup(mtx, 0);
+        kmutex_class_t *cls;
+        uint64_t now = rdtsc();
+
+        if (NULL == kp || NULL == (cls = kp->kp_class))
+                return;
+        kp->kp_locked_at = now;
+
+        cls->kc_nlocks++;
+        if (contended) {
+                cls->kc_ncontended++;
+                cls->kc_waittime += now - start;
+                if (now - start > cls->kc_maxwait)
+                        cls->kc_maxwait = now - start;
+        }
+}
+
+static void
+kmutex_prof_released(kmutex_t *mtx)
+{
+        kmutex_prof_t *kp = kmutex_prof_lookup(mtx, 0);
+        kmutex_class_t *cls;
+        uint64_t held;
+
+        if (NULL == kp || NULL == (cls = kp->kp_class))
+                return;
+
+        held = rdtsc() - kp->kp_locked_at;
+        cls->kc_holdtime += held;
+        if (held > cls->kc_maxhold)
+                cls->kc_maxhold = held;
+        cls->kc_lastpid = curproc->p_pid;
+}
+
+void
+kmutex_init_class(kmutex_t *mtx, kmutex_class_t *cls)
+{
+        sched_queue_init(&mtx->km_waitq);
+        mtx->km_holder = NULL;
+        kmutex_prof_register(mtx, cls);
+}
+
+size_t
+kmutex_prof_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        int n = *(const int *)arg;
+        int count = 0, i, j;
+        kmutex_class_t *cls, **sorted;
+        char site[24];
+
+        KASSERT(NULL != buf);
+
+        list_iterate_begin(&kmutex_classes, cls, kmutex_class_t, kc_link) {
+                ++count;
+        } list_iterate_end();
+        if (0 == count) {
+                iprintf(&buf, &size, "no mutexes\n");
+                return size;
+        }
+        if (NULL == (sorted = kmalloc(count * sizeof(*sorted)))) {
+                iprintf(&buf, &size, "out of memory\n");
+                return size;
+        }
+
+        /* insertion sort, most contended first */
+        i = 0;
+        list_iterate_begin(&kmutex_classes, cls, kmutex_class_t, kc_link) {
+                for (j = i++; j > 0 && sorted[j - 1]->kc_ncontended < cls->kc_ncontended; --j)
+                        sorted[j] = sorted[j - 1];
+                sorted[j] = cls;
+        } list_iterate_end();
+
+        iprintf(&buf, &size, "times in units of 1024 cycles\n");
+        iprintf(&buf, &size, "%-24s %8s %8s %10s %8s %10s %8s %5s\n", "MUTEX", "LOCKS",
+                "CONTEND", "WAIT", "MAXWAIT", "HOLD", "MAXHOLD", "LAST");
+        for (i = 0; i < count && i < n; ++i) {
+                cls = sorted[i];
+                if (NULL == cls->kc_name)
+                        snprintf(site, sizeof(site), "init from 0x%08x", cls->kc_site);
+                iprintf(&buf, &size, "%-24s %8u %8u %10u %8u %10u %8u %5i\n",
+                        NULL == cls->kc_name ? site : cls->kc_name,
+                        cls->kc_nlocks, cls->kc_ncontended,
+                        (uint32_t)(cls->kc_waittime >> 10), (uint32_t)(cls->kc_maxwait >> 10),
+                        (uint32_t)(cls->kc_holdtime >> 10), (uint32_t)(cls->kc_maxhold >> 10),
+                        cls->kc_lastpid);
+        }
+        if (0 != kmutex_prof_dropped)
+                iprintf(&buf, &size, "%u mutexes not tracked, the table is full\n",
+                        kmutex_prof_dropped);
+
+        kfree(sorted);
+        return size;
+}
+#endif
+
+/*
+ * With __MUTEXPROF__ kmutex_init is a macro, which gives every call
+ * site a class of its own; mutexes initialized by calling the function
+ * (from the prebuilt libraries, for instance) are accounted to a class
+ * per caller.
+ */
 void
-kmutex_init(kmutex_t *mtx)
+(kmutex_init)(kmutex_t *mtx)
 {
 	sched_queue_init(&mtx->km_waitq);
 	mtx->km_holder=NULL;
+#ifdef __MUTEXPROF__
+        kmutex_prof_register(mtx, kmutex_site_class((uintptr_t)__builtin_return_address(0)));
+#endif
 }
 
 /*
@@ -38,11 +235,18 @@ kmutex_lock(kmutex_t *mtx)
 {
     KASSERT(curthr && (curthr != mtx->km_holder));
     dbg(DBG_CORE,"Enter kmutex_lock()\n");
+#ifdef __MUTEXPROF__
+        uint64_t start = rdtsc();
+        int contended = (NULL != mtx->km_holder);
+#endif
 	if(mtx->km_holder!=NULL)
 	{
 		sched_sleep_on(&mtx->km_waitq);
 	}
 	mtx->km_holder=curthr;
+#ifdef __MUTEXPROF__
+        kmutex_prof_acquired(mtx, start, contended);
+#endif
 
     dbg(DBG_CORE,"Leave kmutex_lock()\n");
 }
@@ -56,12 +260,18 @@ kmutex_lock_cancellable(kmutex_t *mtx)
 {
     KASSERT(curthr && (curthr != mtx->km_holder));
     dbg(DBG_CORE,"Enter kmutex_lock_cancellable()\n");
+#ifdef __MUTEXPROF__
+    uint64_t start = rdtsc();
+#endif
     if(mtx->km_holder!=NULL)
     {
     	int val=sched_cancellable_sleep_on(&mtx->km_waitq);
     	if(val!=-EINTR)/*thread is not cancelled*/
     	{
     		mtx->km_holder=curthr;
+#ifdef __MUTEXPROF__
+                kmutex_prof_acquired(mtx, start, 1);
+#endif
     	}
         dbg(DBG_CORE,"Leave kmutex_lock_cancellable()\n");
     	return val;
@@ -69,6 +279,9 @@ kmutex_lock_cancellable(kmutex_t *mtx)
     else
     {
     	mtx->km_holder=curthr;
+#ifdef __MUTEXPROF__
+        kmutex_prof_acquired(mtx, start, 0);
+#endif
         dbg(DBG_CORE,"Leave kmutex_lock_cancellable()\n");
     	return 0;
     }
@@ -93,6 +306,9 @@ void
 kmutex_unlock(kmutex_t *mtx)
 {
     KASSERT(curthr && (curthr == mtx->km_holder));
+#ifdef __MUTEXPROF__
+    kmutex_prof_released(mtx);
+#endif
     
     if(mtx->km_holder!=NULL)
     {
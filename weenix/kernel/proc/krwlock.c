@@ -0,0 +1,117 @@
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+
+#include "proc/kthread.h"
+#include "proc/krwlock.h"
+#include "proc/sched.h"
+
+/*
+ * Woken threads are not handed the lock; they check again once they
+ * run, and go back to sleep if someone else got there first. That way
+ * a thread which is woken and cancelled in the same breath never ends
+ * up holding a lock it does not know about.
+ */
+
+void
+krwlock_init(krwlock_t *rw)
+{
+        sched_queue_init(&rw->krw_rdq);
+        sched_queue_init(&rw->krw_wrq);
+        rw->krw_readers = 0;
+        rw->krw_wrwant = 0;
+        rw->krw_writer = NULL;
+}
+
+/*
+ * Wakes whoever can make progress now that the lock has been released
+ * or a waiter has given up: a single writer if the lock is entirely
+ * free, otherwise every reader once no writer wants the lock.
+ */
+static void
+krwlock_wake(krwlock_t *rw)
+{
+        if (NULL != rw->krw_writer)
+                return;
+        if (0 != rw->krw_wrwant) {
+                if (0 == rw->krw_readers)
+                        sched_wakeup_on(&rw->krw_wrq);
+        } else {
+                sched_broadcast_on(&rw->krw_rdq);
+        }
+}
+
+static int
+krwlock_rdlock_common(krwlock_t *rw, int cancellable)
+{
+        KASSERT(curthr && (curthr != rw->krw_writer));
+
+        while (NULL != rw->krw_writer || 0 != rw->krw_wrwant) {
+                if (!cancellable)
+                        sched_sleep_on(&rw->krw_rdq);
+                else if (-EINTR == sched_cancellable_sleep_on(&rw->krw_rdq))
+                        return -EINTR;
+        }
+        rw->krw_readers++;
+        return 0;
+}
+
+static int
+krwlock_wrlock_common(krwlock_t *rw, int cancellable)
+{
+        KASSERT(curthr && (curthr != rw->krw_writer));
+
+        rw->krw_wrwant++;
+        while (NULL != rw->krw_writer || 0 != rw->krw_readers) {
+                if (!cancellable) {
+                        sched_sleep_on(&rw->krw_wrq);
+                } else if (-EINTR == sched_cancellable_sleep_on(&rw->krw_wrq)) {
+                        /* We may have soaked up the wakeup meant for the
+                         * next writer, and readers may have been waiting
+                         * only for us */
+                        rw->krw_wrwant--;
+                        krwlock_wake(rw);
+                        return -EINTR;
+                }
+        }
+        rw->krw_wrwant--;
+        rw->krw_writer = curthr;
+        return 0;
+}
+
+void
+krwlock_rdlock(krwlock_t *rw)
+{
+        krwlock_rdlock_common(rw, 0);
+}
+
+int
+krwlock_rdlock_cancellable(krwlock_t *rw)
+{
+        return krwlock_rdlock_common(rw, 1);
+}
+
+void
+krwlock_wrlock(krwlock_t *rw)
+{
+        krwlock_wrlock_common(rw, 0);
+}
+
+int
+krwlock_wrlock_cancellable(krwlock_t *rw)
+{
+        return krwlock_wrlock_common(rw, 1);
+}
+
+void
+krwlock_unlock(krwlock_t *rw)
+{
+        if (curthr == rw->krw_writer) {
+                rw->krw_writer = NULL;
+        } else {
+                KASSERT(0 < rw->krw_readers);
+                rw->krw_readers--;
+        }
+        krwlock_wake(rw);
+}
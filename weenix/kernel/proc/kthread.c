@@ -2,6 +2,7 @@
 #include "globals.h"
 
 #include "errno.h"
+#include "limits.h"
 
 #include "util/init.h"
 #include "util/debug.h"
@@ -14,6 +15,13 @@
 
 #include "mm/slab.h"
 #include "mm/page.h"
+#include "mm/pagetable.h"
+#include "mm/tlb.h"
+
+#include "main/fpu.h"
+
+#include "api/access.h"
+#include "vm/futex.h"
 
 kthread_t *curthr; /* global */
 static slab_allocator_t *kthread_allocator = NULL;
@@ -28,11 +36,56 @@ static list_t kthread_reapd_deadlist; /* Threads to be cleaned */
 static void *kthread_reapd_run(int arg1, void *arg2);
 #endif
 
+/*
+ * Each kernel stack is KSTACK_SIZE bytes with one extra page
+ * below it which is unmapped, so that overflowing the stack faults
+ * instead of silently corrupting whatever is below it. Freed stacks
+ * are kept (still guarded) in a pool of up to KSTACK_POOL_SIZE, which
+ * saves a trip through the page allocator and the page tables on
+ * every fork; the list link lives in the free stack itself.
+ */
+#define KSTACK_NPAGES (1 + (KSTACK_SIZE >> PAGE_SHIFT))
+
+static list_t kstack_pool;
+static int kstack_pool_count;
+
+#define PT_ENTRY_COUNT (PAGE_SIZE / sizeof(pte_t))
+
+/*
+ * Sets or clears PT_PRESENT in the entry mapping the given page of the
+ * kernel's mapping of physical memory. The kernel's page tables are
+ * shared by every page directory, so this affects all address spaces.
+ * The tables are reached through the temporary mapping, starting from
+ * the physical address of the current page directory.
+ */
+static void
+kstack_guard_set(uintptr_t vaddr, int present)
+{
+        uint32_t pdi = ((uint32_t)vaddr >> PAGE_SHIFT) / PT_ENTRY_COUNT;
+        uint32_t pti = ((uint32_t)vaddr >> PAGE_SHIFT) % PT_ENTRY_COUNT;
+        uintptr_t pdphys = pt_virt_to_phys((uintptr_t)pt_get());
+        pde_t pde = ((pde_t *)pt_phys_tmp_map(pdphys))[pdi];
+        pte_t *pt;
+
+        KASSERT(PAGE_ALIGNED(vaddr));
+        KASSERT(PD_PRESENT & pde);
+        pt = (pte_t *)pt_phys_tmp_map(pde & PAGE_MASK);
+        if (present)
+                pt[pti] |= PT_PRESENT;
+        else
+                pt[pti] &= ~PT_PRESENT;
+        tlb_flush(vaddr);
+}
+
 void
 kthread_init()
 {
         kthread_allocator = slab_allocator_create("kthread", sizeof(kthread_t));
         KASSERT(NULL != kthread_allocator);
+
+        KASSERT(PAGE_ALIGNED(KSTACK_SIZE));
+        list_init(&kstack_pool);
+        kstack_pool_count = 0;
 }
 
 /**
@@ -44,12 +97,19 @@ kthread_init()
 static char *
 alloc_stack(void)
 {
-        /* extra page for "magic" data */
-        char *kstack;
-        int npages = 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT);
-        kstack = (char *)page_alloc_n(npages);
+        char *guard;
+
+        if (!list_empty(&kstack_pool)) {
+                list_link_t *link = kstack_pool.l_next;
+                list_remove(link);
+                --kstack_pool_count;
+                return (char *)link;
+        }
 
-        return kstack;
+        if (NULL == (guard = (char *)page_alloc_n(KSTACK_NPAGES)))
+                return NULL;
+        kstack_guard_set((uintptr_t)guard, 0);
+        return guard + PAGE_SIZE;
 }
 
 /**
@@ -60,12 +120,27 @@ alloc_stack(void)
 static void
 free_stack(char *stack)
 {
-        page_free_n(stack, 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT));
+        if (kstack_pool_count < KSTACK_POOL_SIZE) {
+                list_insert_head(&kstack_pool, (list_link_t *)stack);
+                ++kstack_pool_count;
+                return;
+        }
+
+        kstack_guard_set((uintptr_t)(stack - PAGE_SIZE), 1);
+        page_free_n(stack - PAGE_SIZE, KSTACK_NPAGES);
+}
+
+int
+kthread_stack_guarded(kthread_t *t, uintptr_t addr)
+{
+        uintptr_t stack = (uintptr_t)t->kt_kstack;
+
+        return NULL != t->kt_kstack && addr < stack && addr >= stack - PAGE_SIZE;
 }
 
 /*
  * Allocate a new stack with the alloc_stack function. The size of the
- * stack is DEFAULT_STACK_SIZE.
+ * stack is KSTACK_SIZE.
  *
  * Don't forget to initialize the thread context with the
  * context_setup function. The context should have the same pagetable
@@ -90,13 +165,23 @@ kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2)
         current_thread -> kt_kstack = thread_stack;
         /* Initialize the thread context */
         context_t thread_context;
-        context_setup(&thread_context, func, arg1, arg2, thread_stack, DEFAULT_STACK_SIZE, p -> p_pagedir);
+        context_setup(&thread_context, func, arg1, arg2, thread_stack, KSTACK_SIZE, p -> p_pagedir);
         current_thread -> kt_ctx = thread_context;
         /* Initialize thread's stuff */
         current_thread -> kt_retval = 0;
         current_thread -> kt_errno = 0;
         current_thread -> kt_cancelled = 0;
         current_thread -> kt_wchan = NULL;
+        current_thread -> kt_wwant = 0;
+        current_thread -> kt_fpu = NULL;
+        current_thread -> kt_prio = p -> p_nice;
+#ifdef __MTP__
+        current_thread -> kt_tid = p -> p_nexttid++;
+        current_thread -> kt_detached = 0;
+        current_thread -> kt_joined = 0;
+        current_thread -> kt_cleartid = NULL;
+        sched_queue_init(&current_thread -> kt_joinq);
+#endif
         /* Initialize thread's state */
         current_thread -> kt_state = KT_NO_STATE;
         /* Initialize thread's link */
@@ -117,6 +202,7 @@ kthread_destroy(kthread_t *t)
         dbg(DBG_CORE,"Enter kthread_destroy()\n");
         KASSERT(t && t->kt_kstack);
         free_stack(t->kt_kstack);
+        fpu_release(t);
         if (list_link_is_linked(&t->kt_plink))
                 list_remove(&t->kt_plink);
 
@@ -178,8 +264,33 @@ kthread_exit(void *retval)
         /* Yu Sun Code Start */
         /* Set thread return value */  
         curthr -> kt_retval = retval;
+#ifdef __MTP__
+        if (NULL != curthr->kt_cleartid) {
+                /* Tell userland the thread is gone (e.g. so that the
+                 * stack of a detached thread can be freed), and wake
+                 * anyone waiting on the futex for that. The address
+                 * space is still ours, if it is bad this is the thread
+                 * library's problem. Either may block, so this has to
+                 * happen before the thread is marked exited, which
+                 * sleeping would undo. */
+                int zero = 0;
+                if (0 <= copy_to_user(curthr->kt_cleartid, &zero, sizeof(zero)))
+                        futex_wake(curthr->kt_cleartid, INT_MAX);
+        }
+#endif
         /* Set thread state to KT_EXITED */
         curthr -> kt_state = KT_EXITED;
+#ifdef __MTP__
+        if (curthr->kt_detached) {
+                /* Nobody will join with us, so the reaper frees us once
+                 * we are off this stack */
+                list_remove(&curthr->kt_plink);
+                list_insert_tail(&kthread_reapd_deadlist, &curthr->kt_plink);
+                sched_wakeup_on(&reapd_waitq);
+        } else {
+                sched_broadcast_on(&curthr->kt_joinq);
+        }
+#endif
         /* Alerts the process that the currently executing thread has just exited */
         proc_thread_exited(retval);
         /* Yu Sun Code Finish */
@@ -200,7 +311,7 @@ kthread_clone(kthread_t *thr)
 
         new=(kthread_t*) slab_obj_alloc(kthread_allocator);
         new->kt_kstack = alloc_stack();
-        context_setup(&(new->kt_ctx),NULL,0,NULL,new->kt_kstack,DEFAULT_STACK_SIZE,thr->kt_proc->p_pagedir); 
+        context_setup(&(new->kt_ctx),NULL,0,NULL,new->kt_kstack,KSTACK_SIZE,thr->kt_proc->p_pagedir); 
 
         new->kt_proc = thr->kt_proc; 
         new->kt_retval = thr->kt_retval;
@@ -208,6 +319,20 @@ kthread_clone(kthread_t *thr)
         new->kt_errno = thr->kt_errno;
         new->kt_cancelled = thr->kt_cancelled;
         new->kt_wchan = thr->kt_wchan;
+        new->kt_wwant = 0;
+        new->kt_prio = thr->kt_prio;
+        new->kt_runtime = 0;
+        new->kt_waittime = 0;
+        new->kt_nvcsw = 0;
+        new->kt_nivcsw = 0;
+        fpu_clone(thr, new);
+#ifdef __MTP__
+        new->kt_tid = new->kt_proc->p_nexttid++;
+        new->kt_detached = 0;
+        new->kt_joined = 0;
+        new->kt_cleartid = NULL;
+        sched_queue_init(&new->kt_joinq);
+#endif
         
         if(new->kt_wchan!=NULL)
         {
@@ -230,17 +355,60 @@ kthread_clone(kthread_t *thr)
  * unless your weenix is perfect.
  */
 #ifdef __MTP__
+kthread_t *
+kthread_lookup(struct proc *p, int tid)
+{
+        kthread_t *thr;
+
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                if (tid == thr->kt_tid)
+                        return thr;
+        } list_iterate_end();
+        return NULL;
+}
+
 int
 kthread_detach(kthread_t *kthr)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_detach");
+        KASSERT(NULL != kthr && kthr->kt_proc == curproc);
+
+        /* A joiner which has been woken up but has not run yet is no
+         * longer on kt_joinq, but it still owns the thread */
+        if (kthr->kt_detached || kthr->kt_joined)
+                return -EINVAL;
+
+        kthr->kt_detached = 1;
+        if (KT_EXITED == kthr->kt_state) {
+                /* Too late to let the reaper have it, but since it has
+                 * already exited it can be freed right away */
+                kthread_destroy(kthr);
+        }
         return 0;
 }
 
 int
 kthread_join(kthread_t *kthr, void **retval)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_join");
+        KASSERT(NULL != kthr && kthr->kt_proc == curproc);
+
+        if (kthr == curthr)
+                return -EDEADLK;
+        if (kthr->kt_detached || kthr->kt_joined)
+                return -EINVAL;
+
+        /* Claim the thread before sleeping, so that nobody else can
+         * join, detach or free it while we wait */
+        kthr->kt_joined = 1;
+        while (KT_EXITED != kthr->kt_state) {
+                if (-EINTR == sched_cancellable_sleep_on(&kthr->kt_joinq)) {
+                        kthr->kt_joined = 0;
+                        return -EINTR;
+                }
+        }
+
+        if (NULL != retval)
+                *retval = kthr->kt_retval;
+        kthread_destroy(kthr);
         return 0;
 }
 
@@ -250,7 +418,17 @@ kthread_join(kthread_t *kthr, void **retval)
 static __attribute__((unused)) void
 kthread_reapd_init()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_init");
+        list_init(&kthread_reapd_deadlist);
+        sched_queue_init(&reapd_waitq);
+
+        KASSERT(curproc && (PID_IDLE == curproc->p_pid)
+                && "should be calling this from idleproc");
+        reapd = proc_create("reapd");
+        KASSERT(NULL != reapd);
+        reapd_thr = kthread_create(reapd, kthread_reapd_run, 0, NULL);
+        KASSERT(NULL != reapd_thr);
+
+        sched_make_runnable(reapd_thr);
 }
 init_func(kthread_reapd_init);
 init_depends(sched_init);
@@ -258,13 +436,37 @@ init_depends(sched_init);
 void
 kthread_reapd_shutdown()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_shutdown");
+        KASSERT(PID_IDLE == curproc->p_pid); /* Should call from idleproc */
+        KASSERT(NULL != reapd_thr);
+
+        int pid = reapd->p_pid;
+        kthread_cancel(reapd_thr, (void *) 0);
+        reapd_thr = NULL;
+
+        int child = do_waitpid(pid, 0, NULL);
+        KASSERT(pid == child && "waited on process other than reapd");
 }
 
+/*
+ * Frees detached threads after they have exited. A thread cannot free
+ * its own kernel stack, and by the time the reaper runs every thread
+ * on the dead list has switched off its stack for good.
+ * Both arguments unused.
+ */
 static void *
 kthread_reapd_run(int arg1, void *arg2)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_run");
+        kthread_t *thr;
+
+        while (1) {
+                while (!list_empty(&kthread_reapd_deadlist)) {
+                        thr = list_head(&kthread_reapd_deadlist, kthread_t, kt_plink);
+                        KASSERT(KT_EXITED == thr->kt_state);
+                        kthread_destroy(thr);
+                }
+                if (-EINTR == sched_cancellable_sleep_on(&reapd_waitq))
+                        kthread_exit((void *) 0);
+        }
         return (void *) 0;
 }
 #endif
@@ -16,10 +16,12 @@ Your life will be slightly easier if you choose to use the list macros we have p
 #include "globals.h"
 #include "errno.h"
 
+#include "util/bits.h"
 #include "util/debug.h"
 #include "util/list.h"
 #include "util/string.h"
 #include "util/printf.h"
+#include "util/time.h"
 
 #include "proc/kthread.h"
 #include "proc/proc.h"
@@ -31,6 +33,7 @@ Your life will be slightly easier if you choose to use the list macros we have p
 #include "mm/mmobj.h"
 #include "mm/mm.h"
 #include "mm/mman.h"
+#include "mm/pagetable.h"
 
 #include "vm/vmmap.h"
 
@@ -45,10 +48,25 @@ static slab_allocator_t *proc_allocator = NULL;
 static list_t _proc_list;
 static proc_t *proc_initproc = NULL; /* Pointer to the init process (PID 1) */
 
+/*
+ * The pid table. A pid is taken from the moment its process is created
+ * until the process has been reaped, zombies included, so a bit is set
+ * in the bitmap and the process is in the hash for exactly that long.
+ * PIDs are handed out in increasing order, so taking the pid modulo
+ * the table size spreads them evenly.
+ */
+static uint32_t proc_pidmap[PROC_MAX_COUNT / 32];
+static list_t proc_pidhash[PROC_PID_HASH_SIZE];
+#define proc_pidhash_bucket(pid) (&proc_pidhash[(pid) % PROC_PID_HASH_SIZE])
+
 void
 proc_init()
 {
+        int i;
+
         list_init(&_proc_list);
+        for (i = 0; i < PROC_PID_HASH_SIZE; ++i)
+                list_init(&proc_pidhash[i]);
         proc_allocator = slab_allocator_create("proc", sizeof(proc_t));
         KASSERT(proc_allocator != NULL);
 }
@@ -56,33 +74,98 @@ proc_init()
 static pid_t next_pid = 0;
 
 /**
- * Returns the next available PID.
- *
- * Note: Where n is the number of running processes, this algorithm is
- * worst case O(n^2). As long as PIDs never wrap around it is O(n).
+ * Returns the next available PID, the first free one at or after the
+ * last one handed out. The bitmap is searched a word at a time, so
+ * even when the pids have wrapped around and most are taken, this
+ * looks at no more than PROC_MAX_COUNT / 32 words.
  *
- * @return the next available PID
+ * @return the next available PID, or -1 if all are taken
  */
 static int
 _proc_getid()
 {
-       
-        proc_t *p;
-        pid_t pid = next_pid;
-        while (1) {
-failed:
-                list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
-                        if (p->p_pid == pid) {
-                                if ((pid = (pid + 1) % PROC_MAX_COUNT) == next_pid) {
-                                        return -1;
-                                } else {
-                                        goto failed;
-                                }
-                        }
-                } list_iterate_end();
-                next_pid = (pid + 1) % PROC_MAX_COUNT;
-                return pid;
+        uint32_t free;
+        int i, n;
+
+        i = next_pid >> 5;
+        /* ignore the pids below next_pid in its word the first time */
+        free = ~proc_pidmap[i] & (~(uint32_t) 0 << (next_pid & 0x1f));
+        for (n = 0; n <= PROC_MAX_COUNT / 32; ++n) {
+                if (0 != free) {
+                        pid_t pid = (i << 5) + __builtin_ctz(free);
+                        bit_flip(proc_pidmap, pid);
+                        next_pid = (pid + 1) % PROC_MAX_COUNT;
+                        return pid;
+                }
+                i = (i + 1) % (PROC_MAX_COUNT / 32);
+                free = ~proc_pidmap[i];
         }
+        return -1;
+}
+
+/* Adds p's own resource usage to ru */
+static void
+proc_rusage_add(struct rusage *ru, proc_t *p)
+{
+        ru->ru_runtime += TICKS_TO_MSECS(p->p_runtime);
+        ru->ru_waittime += TICKS_TO_MSECS(p->p_waittime);
+        ru->ru_minflt += p->p_minflt;
+        ru->ru_majflt += p->p_majflt;
+        ru->ru_cowflt += p->p_cowflt;
+        ru->ru_inblock += p->p_inblock;
+        ru->ru_oublock += p->p_oublock;
+        ru->ru_nsyscall += p->p_nsyscall;
+        ru->ru_nvcsw += p->p_nvcsw;
+        ru->ru_nivcsw += p->p_nivcsw;
+}
+
+/* Adds usage which is already totalled up, cru, to ru */
+static void
+proc_rusage_add_children(struct rusage *ru, const struct rusage *cru)
+{
+        ru->ru_runtime += cru->ru_runtime;
+        ru->ru_waittime += cru->ru_waittime;
+        ru->ru_minflt += cru->ru_minflt;
+        ru->ru_majflt += cru->ru_majflt;
+        ru->ru_cowflt += cru->ru_cowflt;
+        ru->ru_inblock += cru->ru_inblock;
+        ru->ru_oublock += cru->ru_oublock;
+        ru->ru_nsyscall += cru->ru_nsyscall;
+        ru->ru_nvcsw += cru->ru_nvcsw;
+        ru->ru_nivcsw += cru->ru_nivcsw;
+}
+
+int
+proc_getrusage(int who, struct rusage *ru)
+{
+        memset(ru, 0, sizeof(*ru));
+        if (RUSAGE_SELF == who) {
+                proc_rusage_add(ru, curproc);
+        } else if (RUSAGE_CHILDREN == who) {
+                *ru = curproc->p_cru;
+        } else {
+                return -EINVAL;
+        }
+        return 0;
+}
+
+/**
+ * Gives a reaped process's pid back and frees the process, adding its
+ * resource usage, and that of its own children, to its parent's.
+ *
+ * @param p the process, which must no longer be on any list
+ */
+static void
+proc_free(proc_t *p)
+{
+        if (NULL != p->p_pproc) {
+                proc_rusage_add(&p->p_pproc->p_cru, p);
+                proc_rusage_add_children(&p->p_pproc->p_cru, &p->p_cru);
+        }
+        KASSERT(bit_check(proc_pidmap, p->p_pid));
+        bit_flip(proc_pidmap, p->p_pid);
+        list_remove(&p->p_hash_link);
+        slab_obj_free(proc_allocator, p);
 }
 
 /*
@@ -98,6 +181,7 @@ proc_create(char *name)
 {
         pid_t pid = _proc_getid();
         dbg(DBG_CORE,"Process %i is created.\n", pid);
+        KASSERT(-1 != pid && "ran out of pids");
         KASSERT(PID_IDLE != pid || list_empty(&_proc_list)); 
         KASSERT(PID_INIT != pid || PID_IDLE == curproc->p_pid); 
         proc_t* process=(proc_t*)slab_obj_alloc(proc_allocator);
@@ -111,12 +195,18 @@ proc_create(char *name)
         
         process->p_status=0;
         process->p_state=PROC_RUNNING;
+        /* children inherit their parent's niceness */
+        process->p_nice=(NULL != curproc) ? curproc->p_nice : 0;
+#ifdef __MTP__
+        process->p_nexttid=1;
+#endif
         sched_queue_init(&process->p_wait);
         process->p_pagedir=pt_create_pagedir();
        
         list_link_init(&process->p_list_link);
         list_link_init(&process->p_child_link);
         list_insert_tail(&_proc_list,&process->p_list_link);
+        list_insert_head(proc_pidhash_bucket(pid),&process->p_hash_link);
 
         if(process->p_pid==PID_IDLE)
         {
@@ -150,6 +240,46 @@ proc_create(char *name)
         return process;
 }
 
+void
+proc_inherit_files(proc_t *child)
+{
+        int fd;
+
+        KASSERT(child->p_pproc == curproc);
+        for (fd = 0; fd < NFILES; ++fd) {
+                if (NULL != (child->p_files[fd] = curproc->p_files[fd]))
+                        fref(child->p_files[fd]);
+        }
+        if (NULL != child->p_cwd)
+                vput(child->p_cwd);
+        if (NULL != (child->p_cwd = curproc->p_cwd))
+                vref(child->p_cwd);
+}
+
+void
+proc_vfork_release(proc_t *p)
+{
+        proc_t *parent = p->p_vforkparent;
+        kthread_t *thr;
+
+        if (NULL == parent)
+                return;
+
+        /* The map stays with the parent, which never stopped owning it */
+        p->p_vmmap = NULL;
+        p->p_pagedir = p->p_vforkpagedir;
+        p->p_vforkpagedir = NULL;
+        p->p_vforkparent = NULL;
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                thr->kt_ctx.c_pdptr = p->p_pagedir;
+        } list_iterate_end();
+        if (p == curproc)
+                pt_set(p->p_pagedir);
+
+        /* The parent may have other threads waiting in waitpid */
+        sched_broadcast_on(&parent->p_wait);
+}
+
 /**
  * Cleans up as much as the process as can be done from within the
  * process. This involves:
@@ -189,6 +319,7 @@ proc_cleanup(int status)
     {
     if(curproc->p_pid!=PID_IDLE)
     {
+        proc_vfork_release(curproc);
         dbg_print("Enter clean files...\n");
         int fd = 0;
         for(fd=0;fd<NFILES;fd++)
@@ -275,6 +406,8 @@ proc_kill(proc_t *p, int status)
             p->p_state=PROC_DEAD;
             p->p_status=status;
             list_remove(&p->p_child_link);
+            /* never destroy a page directory we only borrowed */
+            proc_vfork_release(p);
             
             list_iterate_begin(&p->p_threads,thread,kthread_t,kt_plink)
             {
@@ -283,7 +416,7 @@ proc_kill(proc_t *p, int status)
             list_remove(&p->p_list_link);
             pt_destroy_pagedir(p->p_pagedir);
             dbg(DBG_CORE,"Process %i has been killled by current process.\n", p -> p_pid);
-            slab_obj_free(proc_allocator, p);
+            proc_free(p);
 
         }
 }
@@ -324,7 +457,10 @@ proc_t *
 proc_lookup(int pid)
 {
         proc_t *p;
-        list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
+
+        if (pid < 0 || pid >= PROC_MAX_COUNT)
+                return NULL;
+        list_iterate_begin(proc_pidhash_bucket(pid), p, proc_t, p_hash_link) {
                 if (p->p_pid == pid) {
                         return p;
                 }
@@ -350,7 +486,19 @@ void
 proc_thread_exited(void *retval)
 {
     dbg(DBG_CORE,"Enter proc_thread_exited\n");
-    proc_cleanup(0);
+#ifdef __MTP__
+    kthread_t *thread;
+    list_iterate_begin(&curproc->p_threads,thread,kthread_t,kt_plink)
+    {
+        if(thread->kt_state!=KT_EXITED)
+        {
+            /* not the last thread, so the process lives on without us */
+            sched_switch();
+            panic("exited thread %p was scheduled again\n", curthr);
+        }
+    }list_iterate_end();
+#endif
+    proc_cleanup(curproc->p_status);
     dbg(DBG_CORE,"Enter proc_thread_exited\n");
 }
 
@@ -370,6 +518,31 @@ proc_thread_exited(void *retval)
  * Options other than 0 are not supported.
  */
 
+/*
+ * Disposes of a dead child of the current process, returning its pid.
+ */
+static pid_t
+proc_reap(proc_t *child, int *status)
+{
+        pid_t pid = child->p_pid;
+        kthread_t *thread;
+
+        KASSERT(PROC_DEAD == child->p_state);
+        if(status!=NULL)
+            *status=child->p_status;
+        list_iterate_begin(&child->p_threads,thread,kthread_t,kt_plink)
+        {
+            KASSERT(KT_EXITED == thread->kt_state);/* thr points to a thread to be destroied */
+            kthread_destroy(thread);
+        }list_iterate_end();
+        list_remove(&child->p_child_link);
+
+        KASSERT(NULL != child->p_pagedir); /* this process should have pagedir */
+        pt_destroy_pagedir(child->p_pagedir);
+        proc_free(child);
+        return pid;
+}
+
 pid_t
 do_waitpid(pid_t pid, int options, int *status)
 {
@@ -386,65 +559,21 @@ do_waitpid(pid_t pid, int options, int *status)
             {
                 KASSERT(NULL != child); /* the process should not be NULL */
                 if(child->p_state==PROC_DEAD)
-                {
-                    KASSERT(-1 == pid || child->p_pid == pid); /* should be able to find the process*/                 
-                    *status=child->p_status;
-                    kthread_t *thread;
-                    list_iterate_begin(&child->p_threads,thread,kthread_t,kt_plink)
-                    {
-                        if(thread->kt_state!=KT_EXITED)
-                        {
-                            KASSERT(KT_EXITED == thread->kt_state);/* thr points to a thread to be destroied */                         
-                            kthread_destroy(thread);
-                        }                           
-                    }list_iterate_end();
-                    list_remove(&child->p_child_link);
-
-                    KASSERT(NULL != child->p_pagedir); /* this process should have pagedir */
-                    pt_destroy_pagedir(child->p_pagedir);
-                    slab_obj_free(proc_allocator, child);
-                    return child->p_pid;
-                }
+                    return proc_reap(child, status);
             }list_iterate_end();
             sched_sleep_on(&curproc->p_wait);
         }while(1);
     }
     else 
     {
-        list_iterate_begin(&curproc->p_children,child,proc_t,p_child_link)
-        {            
-            KASSERT(NULL != child); /* the process should not be NULL */ 
-            if(child->p_pid==pid)
-            {
-                KASSERT(-1 == pid || child->p_pid == pid); /* should be able to find the process */
-                do
-                {
-                    if(child->p_state==PROC_DEAD)
-                    {
-                        *status=child->p_status;
-                        kthread_t *thread;
-                        list_iterate_begin(&child->p_threads,thread,kthread_t,kt_plink)
-                        {
-                            if(thread->kt_state!=KT_EXITED)
-                            {
-                                KASSERT(KT_EXITED == thread->kt_state);/* thr points to a thread to be destroied */ 
-                                kthread_destroy(thread);
-                            }                           
-                        }list_iterate_end();
-                        list_remove(&child->p_child_link);
-                        KASSERT(NULL != child->p_pagedir); /* this process should have pagedir */
-                        pt_destroy_pagedir(child->p_pagedir);
-                        slab_obj_free(proc_allocator, child);
-                        return child->p_pid;
-                    }
-                    else
-                    {
-                        sched_sleep_on(&curproc->p_wait);
-                    }
-                }while(1);
-            }    
-        }list_iterate_end();
-        return -ECHILD;
+        /* the pid table finds it without walking all our children */
+        child = proc_lookup(pid);
+        if(child==NULL||child->p_pproc!=curproc)
+            return -ECHILD;
+        KASSERT(child->p_pid == pid); /* should be able to find the process */
+        while(child->p_state!=PROC_DEAD)
+            sched_sleep_on(&curproc->p_wait);
+        return proc_reap(child, status);
     }
 }
 
@@ -461,6 +590,17 @@ do_exit(int status)
     dbg(DBG_CORE,"Enter do_exit\n");
     kthread_t *thread;
     curproc->p_status=status;
+#ifdef __MTP__
+    /* The process is cleaned up when its last thread exits, see
+     * proc_thread_exited */
+    list_iterate_begin(&curproc->p_threads,thread,kthread_t,kt_plink)
+    {
+        if(thread!=curthr&&thread->kt_state!=KT_EXITED)
+        {
+            kthread_cancel(thread,NULL);
+        }
+    }list_iterate_end();
+#endif
     kthread_exit(NULL);
     dbg(DBG_CORE,"Leave do_exit\n");
 }
@@ -471,6 +611,7 @@ proc_info(const void *arg, char *buf, size_t osize)
         const proc_t *p = (proc_t *) arg;
         size_t size = osize;
         proc_t *child;
+        kthread_t *thr;
 
         KASSERT(NULL != p);
         KASSERT(NULL != buf);
@@ -504,6 +645,23 @@ proc_info(const void *arg, char *buf, size_t osize)
 
         iprintf(&buf, &size, "status:       %i\n", p->p_status);
         iprintf(&buf, &size, "state:        %i\n", p->p_state);
+        iprintf(&buf, &size, "nice:         %i\n", p->p_nice);
+        iprintf(&buf, &size, "run time:     %u ms\n", TICKS_TO_MSECS(p->p_runtime));
+        iprintf(&buf, &size, "wait time:    %u ms\n", TICKS_TO_MSECS(p->p_waittime));
+        iprintf(&buf, &size, "switches:     %u voluntary, %u involuntary\n",
+                p->p_nvcsw, p->p_nivcsw);
+        iprintf(&buf, &size, "faults:       %u minor, %u major, %u copy-on-write\n",
+                p->p_minflt, p->p_majflt, p->p_cowflt);
+        iprintf(&buf, &size, "blocks:       %u in, %u out\n", p->p_inblock, p->p_oublock);
+        iprintf(&buf, &size, "syscalls:     %u\n", p->p_nsyscall);
+        iprintf(&buf, &size, "reaped:       run %lu ms, %lu/%lu faults, %lu/%lu blocks\n",
+                p->p_cru.ru_runtime, p->p_cru.ru_minflt, p->p_cru.ru_majflt,
+                p->p_cru.ru_inblock, p->p_cru.ru_oublock);
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                iprintf(&buf, &size, "     thread 0x%p: run %u ms, wait %u ms, %u/%u switches\n",
+                        thr, TICKS_TO_MSECS(thr->kt_runtime), TICKS_TO_MSECS(thr->kt_waittime),
+                        thr->kt_nvcsw, thr->kt_nivcsw);
+        } list_iterate_end();
 
 #ifdef __VFS__
 #ifdef __GETCWD__
@@ -13,28 +13,112 @@ void sched_switch(void);
 void sched_make_runnable(kthread_t *thr);
 The most difficult of these functions to get correct is sched_switch, although with a little care it should not be too bad.
 */
+#include "kernel.h"
+#include "config.h"
 #include "globals.h"
 #include "errno.h"
 
 #include "main/interrupt.h"
+#include "main/fpu.h"
 
 #include "proc/sched.h"
 #include "proc/kthread.h"
+#include "proc/workq.h"
 
 #include "util/init.h"
 #include "util/debug.h"
+#include "util/printf.h"
+#include "util/time.h"
+#include "util/timer.h"
 
-static ktqueue_t kt_runq;
+#include "vm/anon.h"
+
+/*
+ * The run queue is really a multi-level feedback queue: one FIFO per
+ * priority level, 0 being the highest. Bit i of kt_runq_bitmap is set
+ * exactly when kt_runq[i] is non-empty, so finding the next thread to
+ * run is a single bit scan regardless of how many are runnable.
+ *
+ * Threads that use up their time slice sink one level, threads that
+ * are woken up after sleeping rise one level, and every
+ * SCHED_BOOST_TICKS everything runnable goes back to the top so CPU
+ * bound threads cannot be starved forever. A process's nice value is
+ * the highest level its threads can reach.
+ */
+static ktqueue_t kt_runq[SCHED_NPRIO];
+static uint32_t kt_runq_bitmap;
+
+/* The tick at or after which the next boost is due. This is a deadline
+ * rather than a multiple of SCHED_BOOST_TICKS since with __TICKLESS__
+ * time_ticks can move on by many ticks at once. The boost itself walks
+ * every runnable thread, so the clock interrupt leaves it to workd. */
+static uint32_t sched_next_boost;
+static work_t sched_boost_work;
+
+static void sched_boost(void *arg);
+
+/*
+ * CPU accounting is done in whole clock ticks. sched_oncpu is the
+ * thread whose running time is being counted, or NULL while nobody's
+ * is, e.g. when sched_switch is waiting for something to become
+ * runnable. Bucket 0 of sched_wait_hist counts run queue waits of
+ * less than a tick, bucket n > 0 those of [2^(n-1), 2^n) ticks and
+ * the last bucket everything longer.
+ */
+#define SCHED_WAIT_BUCKETS 12
+static kthread_t *sched_oncpu;
+static uint32_t sched_wait_hist[SCHED_WAIT_BUCKETS];
 
 static __attribute__((unused)) void
 sched_init(void)
 {
-        sched_queue_init(&kt_runq);
+        int i;
+
+        KASSERT(SCHED_NPRIO <= 32 && "kt_runq_bitmap is too small");
+        for (i = 0; i < SCHED_NPRIO; ++i)
+                sched_queue_init(&kt_runq[i]);
+        kt_runq_bitmap = 0;
+        sched_next_boost = time_ticks + SCHED_BOOST_TICKS;
+        work_init(&sched_boost_work, sched_boost, NULL);
 }
 init_func(sched_init);
 
 
 
+/*** PRIVATE ACCOUNTING FUNCTIONS ***/
+/* All of these must be called with interrupts masked */
+
+/* Charges the thread that was running for its time on the processor */
+static void
+sched_account_run(uint32_t now)
+{
+        kthread_t *thr = sched_oncpu;
+
+        if (NULL == thr)
+                return;
+        thr->kt_runtime += now - thr->kt_stamp;
+        thr->kt_proc->p_runtime += now - thr->kt_stamp;
+        thr->kt_stamp = now;
+        sched_oncpu = NULL;
+}
+
+/* Charges a thread that is about to run for its wait on the run queue */
+static void
+sched_account_wait(kthread_t *thr, uint32_t now)
+{
+        uint32_t wait = now - thr->kt_stamp;
+        int bucket = 0;
+
+        while (wait >> bucket && bucket < SCHED_WAIT_BUCKETS - 1)
+                ++bucket;
+        ++sched_wait_hist[bucket];
+
+        thr->kt_waittime += wait;
+        thr->kt_proc->p_waittime += wait;
+        thr->kt_stamp = now;
+        sched_oncpu = thr;
+}
+
 /*** PRIVATE KTQUEUE MANIPULATION FUNCTIONS ***/
 /**
  * Enqueues a thread onto a queue.
@@ -91,6 +175,93 @@ ktqueue_remove(ktqueue_t *q, kthread_t *thr)
         q->tq_size--;
 }
 
+/*** PRIVATE RUN QUEUE MANIPULATION FUNCTIONS ***/
+/* All of these must be called with interrupts masked. */
+
+/**
+ * Returns the highest priority level a thread may be at.
+ */
+static int
+kthread_base_prio(kthread_t *thr)
+{
+        return thr->kt_proc->p_nice;
+}
+
+/**
+ * Returns the length of a time slice at the given priority level.
+ * Lower priority threads run less often but for longer, which keeps
+ * CPU bound threads from being switched out more than they need to.
+ */
+static int
+sched_quantum(int prio)
+{
+        return SCHED_QUANTUM_TICKS * (1 + prio);
+}
+
+static int
+runq_contains(kthread_t *thr)
+{
+        return thr->kt_wchan >= &kt_runq[0]
+               && thr->kt_wchan < &kt_runq[SCHED_NPRIO];
+}
+
+static void
+runq_enqueue(kthread_t *thr)
+{
+        KASSERT(0 <= thr->kt_prio && thr->kt_prio < SCHED_NPRIO);
+        ktqueue_enqueue(&kt_runq[thr->kt_prio], thr);
+        kt_runq_bitmap |= (1 << thr->kt_prio);
+}
+
+static kthread_t *
+runq_dequeue(void)
+{
+        kthread_t *thr;
+        int prio;
+
+        if (0 == kt_runq_bitmap)
+                return NULL;
+
+        prio = __builtin_ctz(kt_runq_bitmap);
+        thr = ktqueue_dequeue(&kt_runq[prio]);
+        KASSERT(NULL != thr);
+        if (sched_queue_empty(&kt_runq[prio]))
+                kt_runq_bitmap &= ~(1 << prio);
+        return thr;
+}
+
+/**
+ * Moves every runnable thread back up to its base priority.
+ */
+static void
+runq_boost_all(void)
+{
+        ktqueue_t boosted;
+        kthread_t *thr;
+        int prio;
+
+        sched_queue_init(&boosted);
+        for (prio = 1; prio < SCHED_NPRIO; ++prio) {
+                while (NULL != (thr = ktqueue_dequeue(&kt_runq[prio])))
+                        ktqueue_enqueue(&boosted, thr);
+                kt_runq_bitmap &= ~(1 << prio);
+        }
+        while (NULL != (thr = ktqueue_dequeue(&boosted))) {
+                thr->kt_prio = kthread_base_prio(thr);
+                runq_enqueue(thr);
+        }
+}
+
+/* The work function which does the periodic boost. Arg unused. */
+static void
+sched_boost(void *arg)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        runq_boost_all();
+        intr_setipl(ipl);
+}
+
 /*** PUBLIC KTQUEUE MANIPULATION FUNCTIONS ***/
 void
 sched_queue_init(ktqueue_t *q)
@@ -105,84 +276,226 @@ sched_queue_empty(ktqueue_t *q)
         return list_empty(&q->tq_list);
 }
 
+/*
+ * Context for a sleep with a timeout, lives on the sleeping thread's
+ * stack until the thread wakes up and deletes its timer.
+ */
+typedef struct sched_timeout {
+        kthread_t      *st_thr;
+        int             st_expired;
+} sched_timeout_t;
+
+/*
+ * Timer function for sleeps with a timeout, runs in interrupt context.
+ * The thread may have been woken up or cancelled while the timer was
+ * on its way to firing, in which case there is nothing to do.
+ */
+static void
+sched_timeout_expired(void *arg)
+{
+        sched_timeout_t *st = (sched_timeout_t *)arg;
+        kthread_t *thr = st->st_thr;
+
+        if (KT_SLEEP == thr->kt_state || KT_SLEEP_CANCELLABLE == thr->kt_state) {
+                ktqueue_remove(thr->kt_wchan, thr);
+                st->st_expired = 1;
+                sched_make_runnable(thr);
+        }
+}
+
+/*
+ * Common code for all of the sleep functions. The queue is manipulated
+ * with interrupts masked, since threads may be woken up (or timed out)
+ * from interrupt context.
+ *
+ * @param q the queue to sleep on
+ * @param state KT_SLEEP or KT_SLEEP_CANCELLABLE
+ * @param want for an exclusive sleep the units waited for, else 0
+ * @param timed true if the sleep should time out after ticks
+ * @param ticks the number of clock ticks to sleep for at most
+ * @return -EINTR if the sleep was cancelled, -ETIMEDOUT if it timed
+ * out and 0 otherwise
+ */
+static int
+sched_sleep(ktqueue_t *q, int state, uint32_t want, int timed, uint32_t ticks)
+{
+        sched_timeout_t st;
+        ktimer_t timer;
+        uint8_t ipl;
+
+        if (KT_SLEEP_CANCELLABLE == state && curthr->kt_cancelled)
+                return -EINTR;
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        curthr->kt_state = state;
+        curthr->kt_wwant = want;
+        ktqueue_enqueue(q, curthr);
+        if (timed) {
+                st.st_thr = curthr;
+                st.st_expired = 0;
+                ktimer_init(&timer, sched_timeout_expired, &st);
+                ktimer_add(&timer, ticks);
+        }
+
+        sched_switch();
+
+        if (timed)
+                ktimer_del(&timer);
+        intr_setipl(ipl);
+
+        if (KT_SLEEP_CANCELLABLE == state && curthr->kt_cancelled)
+                return -EINTR;
+        if (timed && st.st_expired)
+                return -ETIMEDOUT;
+        return 0;
+}
+
 /*
  * Updates the thread's state and enqueues it on the given
  * queue. Returns when the thread has been woken up with wakeup_on or
  * broadcast_on.
- *
- * Use the private queue manipulation functions above.
  */
 void
 sched_sleep_on(ktqueue_t *q)
 {
-        /* ---------------------heguang-------------------- */
-        curthr->kt_state=KT_SLEEP;
-        ktqueue_enqueue(q,curthr);
-        sched_switch();
-        /* ---------------------heguang-------------------- */
-
+        sched_sleep(q, KT_SLEEP, 0, 0, 0);
 }
 
-
 /*
- * Similar to sleep on, but the sleep can be cancelled.
- *
- * Don't forget to check the kt_cancelled flag at the correct times.
- *
- * Use the private queue manipulation functions above.
+ * Similar to sleep on, but the sleep can be cancelled. A thread which
+ * has already been cancelled does not go to sleep at all.
  */
 int
 sched_cancellable_sleep_on(ktqueue_t *q)
 {
-    dbg(DBG_CORE,"Enter sched_cancellable_sleep_on()\n");
+        return sched_sleep(q, KT_SLEEP_CANCELLABLE, 0, 0, 0);
+}
 
-    /* ---------------------heguang-------------------- */
-        curthr->kt_state=KT_SLEEP_CANCELLABLE;
-        ktqueue_enqueue(q,curthr);
-        sched_switch();
+int
+sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_sleep(q, KT_SLEEP, 0, 1, ticks);
+}
 
-        /* Yu Sun Edit Start */
-        if(curthr -> kt_cancelled == 1) {
-            dbg(DBG_CORE,"Leave sched_cancellable_sleep_on()\n");
-                return -EINTR;
-        }
-        else {
-            dbg(DBG_CORE,"Leave sched_cancellable_sleep_on()\n");
-                return 0;
-        }
+int
+sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_sleep(q, KT_SLEEP_CANCELLABLE, 0, 1, ticks);
+}
+
+/*
+ * Exclusive sleeps. A thread sleeping exclusively is waiting for some
+ * amount of a resource which not every waiter can have, so waking all
+ * of them would only send most straight back to sleep.
+ */
+void
+sched_sleep_on_excl(ktqueue_t *q, uint32_t want)
+{
+        KASSERT(0 < want);
+        sched_sleep(q, KT_SLEEP, want, 0, 0);
+}
 
-        panic("Return in sched_cancellable_sleep_on()!!!\n");
-    /* ---------------------heguang-------------------- */
+int
+sched_cancellable_sleep_on_excl(ktqueue_t *q, uint32_t want)
+{
+        KASSERT(0 < want);
+        return sched_sleep(q, KT_SLEEP_CANCELLABLE, want, 0, 0);
+}
+
+/*
+ * Takes a sleeping thread off the queue it is sleeping on and makes it
+ * runnable. Must be called with interrupts masked.
+ */
+static void
+sched_wake(kthread_t *thr)
+{
+        KASSERT((thr->kt_state == KT_SLEEP) || (thr->kt_state == KT_SLEEP_CANCELLABLE));
+        ktqueue_remove(thr->kt_wchan, thr);
+        /* reward the thread for blocking instead of using the processor */
+        if (thr->kt_prio > kthread_base_prio(thr))
+                thr->kt_prio--;
+        sched_make_runnable(thr);
 }
 
 kthread_t *
 sched_wakeup_on(ktqueue_t *q)
 {
-    dbg(DBG_CORE,"Enter sched_wakeup_on()\n");
-    /* ---------------------heguang-------------------- */
-    kthread_t *waked=NULL;
-    if(!sched_queue_empty(q))
-    {
-        waked=ktqueue_dequeue(q);
+        kthread_t *waked = NULL;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
 
-        KASSERT((waked->kt_state == KT_SLEEP) || (waked->kt_state == KT_SLEEP_CANCELLABLE));
-        sched_make_runnable(waked);
+        if (!sched_queue_empty(q)) {
+                waked = list_tail(&q->tq_list, kthread_t, kt_qlink);
+                sched_wake(waked);
+        }
 
-    }       
-        dbg(DBG_CORE,"Leave sched_wakeup_on()\n");
+        intr_setipl(ipl);
         return waked;
 }
 
+int
+sched_wakeup_n(ktqueue_t *q, int n)
+{
+        kthread_t *thr;
+        int woken = 0;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        /* oldest first, the queue is filled from the head */
+        list_iterate_reverse(&q->tq_list, thr, kthread_t, kt_qlink) {
+                if (0 != thr->kt_wwant) {
+                        if (0 >= n)
+                                continue;
+                        n--;
+                }
+                sched_wake(thr);
+                woken++;
+        } list_iterate_end();
+
+        intr_setipl(ipl);
+        return woken;
+}
+
+int
+sched_wakeup_avail(ktqueue_t *q, uint32_t avail)
+{
+        kthread_t *thr;
+        int woken = 0, woke_excl = 0, exhausted = 0;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        list_iterate_reverse(&q->tq_list, thr, kthread_t, kt_qlink) {
+                if (0 != thr->kt_wwant) {
+                        /* Stop at the first waiter which does not fit, so
+                         * that smaller requests behind it cannot starve it.
+                         * The oldest one is always woken, so that someone
+                         * finds out the resource is still short. */
+                        if (exhausted || (woke_excl && thr->kt_wwant > avail)) {
+                                exhausted = 1;
+                                continue;
+                        }
+                        avail -= MIN(avail, thr->kt_wwant);
+                        woke_excl = 1;
+                }
+                sched_wake(thr);
+                woken++;
+        } list_iterate_end();
+
+        intr_setipl(ipl);
+        return woken;
+}
+
 void
 sched_broadcast_on(ktqueue_t *q)
 {
-    dbg(DBG_CORE,"Enter sched_broadcast_on()\n");
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
 
-      while(q->tq_size!=0)
-      {
-        sched_wakeup_on(q);
-      } 
-    dbg(DBG_CORE,"Leave sched_broadcast_on()\n");
+        while (NULL != sched_wakeup_on(q));
+
+        intr_setipl(ipl);
 }
 
 /*
@@ -197,16 +510,17 @@ sched_broadcast_on(ktqueue_t *q)
 void
 sched_cancel(struct kthread *kthr)
 {
-    dbg(DBG_CORE,"Enter sched_cancel()\n");
-        /* Yu Sun Code Start */
-        kthr -> kt_cancelled = 1;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        kthr->kt_cancelled = 1;
         /* Remove it from the wait queue, move it to runq */
-        if(kthr -> kt_state == KT_SLEEP_CANCELLABLE) {
-                ktqueue_remove(kthr -> kt_wchan, kthr);
+        if (kthr->kt_state == KT_SLEEP_CANCELLABLE) {
+                ktqueue_remove(kthr->kt_wchan, kthr);
                 sched_make_runnable(kthr);
         }
-        dbg(DBG_CORE,"Leave sched_cancel()\n");
-        /* Yu Sun Code Finish */
+
+        intr_setipl(ipl);
 }
 
 /*
@@ -243,7 +557,8 @@ sched_cancel(struct kthread *kthr)
  * returns, a different thread should be executing than the thread
  * which was executing when sched_switch was called.
  *
- * Note: The IPL is process specific.
+ * Note: The IPL is process specific. The APIC does not know that, so
+ * each thread restores the IPL it had once it is switched back to.
  */
 void
 sched_switch(void)
@@ -254,7 +569,10 @@ sched_switch(void)
         uint8_t curr_ipl=intr_getipl();
         intr_setipl(IPL_HIGH);
         kthread_t *old=curthr;
-        kthread_t *new=ktqueue_dequeue(&kt_runq);
+        /* a thread still runnable here was preempted or yielded */
+        int voluntary=(KT_RUN!=old->kt_state);
+        sched_account_run(time_ticks);
+        kthread_t *new=runq_dequeue();
        
        while(new==NULL)
        {
@@ -268,17 +586,46 @@ sched_switch(void)
                 }
                 */
                 dbg(DBG_CORE,"Run queue is empty\n");
+                /* zero pages for later faults while there is nothing
+                 * else to do, looking at the run queue after each; the
+                 * clock keeps ticking meanwhile, and only stops once
+                 * the processor is about to halt */
                 intr_setipl(IPL_LOW);
-                intr_wait();
-                intr_setipl(IPL_HIGH); 
-                new=ktqueue_dequeue(&kt_runq);
+                if(!anon_zero_idle())
+                {
+                        intr_setipl(IPL_HIGH);
+                        time_idle_start();
+                        intr_setipl(IPL_LOW);
+                        intr_wait();
+                        intr_setipl(IPL_HIGH);
+                        time_idle_stop();
+                }
+                intr_setipl(IPL_HIGH);
+                new=runq_dequeue();
         }
+       if(new!=old)
+       {
+                if(voluntary)
+                {
+                        old->kt_nvcsw++;
+                        old->kt_proc->p_nvcsw++;
+                }
+                else
+                {
+                        old->kt_nivcsw++;
+                        old->kt_proc->p_nivcsw++;
+                }
+       }
+       sched_account_wait(new,time_ticks);
+       new->kt_quantum=sched_quantum(new->kt_prio);
+       new->kt_preempt=0;
        curthr=new;
        curproc=curthr->kt_proc;
-       intr_setipl(curr_ipl);
+       fpu_switch(new);
        dbg(DBG_CORE,"Leave sched_switch()\n");
        context_switch(&old->kt_ctx,&new->kt_ctx);
-       
+       intr_setipl(curr_ipl);
+
         /* ---------------------heguang-------------------- */
 }
 
@@ -298,15 +645,24 @@ sched_switch(void)
 void
 sched_make_runnable(kthread_t *thr)
 {
-        KASSERT(&kt_runq != thr->kt_wchan); /* make sure thread is not blocked*/
+        KASSERT(!runq_contains(thr)); /* make sure thread is not blocked*/
 
         dbg(DBG_CORE,"Enter sched_make_runnable()\n");
         /* ---------------------heguang-------------------- */
         uint8_t curr_ipl=intr_getipl();
         intr_setipl(IPL_HIGH);
 
+        /* the running thread may be putting itself back on the run
+         * queue, in which case its time on the processor ends here */
+        if (thr == sched_oncpu)
+                sched_account_run(time_ticks);
+        thr->kt_stamp=time_ticks;
         thr->kt_state=KT_RUN;
-        ktqueue_enqueue(&kt_runq,thr);
+        runq_enqueue(thr);
+        /* a thread that outranks the one running gets the processor
+         * the next time it is safe to preempt */
+        if (NULL != curthr && curthr != thr && thr->kt_prio < curthr->kt_prio)
+                curthr->kt_preempt = 1;
 
         intr_setipl(curr_ipl);
     dbg(DBG_CORE,"Leave sched_make_runnable()\n");
@@ -330,3 +686,108 @@ sched_make_runnable(kthread_t *thr)
 
 
 
+
+/*
+ * Runs in interrupt context. The thread we interrupted may not be
+ * running at all: when the run queue is empty sched_switch waits for
+ * interrupts with curthr still pointing at the thread that went to
+ * sleep, which must not be charged for the idle time.
+ */
+void
+sched_tick(void)
+{
+        if ((int32_t)(time_ticks - sched_next_boost) >= 0) {
+                work_schedule(&sched_boost_work);
+                sched_next_boost = time_ticks + SCHED_BOOST_TICKS;
+        }
+
+        if (NULL == curthr || KT_RUN != curthr->kt_state)
+                return;
+
+        if (--curthr->kt_quantum == 0) {
+                /* used up the whole slice, so probably CPU bound */
+                if (curthr->kt_prio < SCHED_NPRIO - 1)
+                        curthr->kt_prio++;
+                curthr->kt_preempt = 1;
+        }
+}
+
+/*
+ * The interrupted thread goes to the back of its run queue, so other
+ * runnable threads get a turn before it runs again. If nothing else is
+ * runnable sched_switch just picks the same thread again.
+ */
+void
+sched_preempt(void)
+{
+        if (!curthr->kt_preempt)
+                return;
+
+        dbg(DBG_SCHED, "preempting thread %p of proc %d\n",
+            curthr, curproc->p_pid);
+        sched_make_runnable(curthr);
+        sched_switch();
+}
+
+int
+sched_nice(proc_t *p, int incr)
+{
+        kthread_t *thr;
+        int nice;
+
+        /* Only init and the kernel's own processes, which are all
+         * children of the idle process, may raise a priority */
+        if (incr < 0 && PID_IDLE != curproc->p_pid
+            && (NULL == curproc->p_pproc || PID_IDLE != curproc->p_pproc->p_pid))
+                return -EPERM;
+
+        nice = p->p_nice + incr;
+        if (nice < 0)
+                nice = 0;
+        if (nice > SCHED_NPRIO - 1)
+                nice = SCHED_NPRIO - 1;
+        p->p_nice = nice;
+
+        /* Threads which are currently runnable keep their place until
+         * they are next scheduled, the new floor applies from then on */
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                if (thr->kt_prio < nice)
+                        thr->kt_prio = nice;
+        } list_iterate_end();
+
+        return nice;
+}
+
+size_t
+sched_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        proc_t *p;
+        uint32_t lo, hi;
+        int i;
+
+        KASSERT(NULL == arg);
+        KASSERT(NULL != buf);
+
+        iprintf(&buf, &size, "%5s %-13s %10s %10s %8s %8s\n",
+                "PID", "NAME", "RUN(ms)", "WAIT(ms)", "VCSW", "IVCSW");
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                iprintf(&buf, &size, " %3i  %-13s %10u %10u %8u %8u\n",
+                        p->p_pid, p->p_comm,
+                        TICKS_TO_MSECS(p->p_runtime), TICKS_TO_MSECS(p->p_waittime),
+                        p->p_nvcsw, p->p_nivcsw);
+        } list_iterate_end();
+
+        iprintf(&buf, &size, "\nrun queue wait (ms):\n");
+        iprintf(&buf, &size, "%6s - %-6u %u\n", "0", TICK_MSECS - 1, sched_wait_hist[0]);
+        for (i = 1; i < SCHED_WAIT_BUCKETS - 1; ++i) {
+                lo = TICKS_TO_MSECS(1U << (i - 1));
+                hi = TICKS_TO_MSECS(1U << i) - 1;
+                iprintf(&buf, &size, "%6u - %-6u %u\n", lo, hi, sched_wait_hist[i]);
+        }
+        iprintf(&buf, &size, "%6u +        %u\n",
+                TICKS_TO_MSECS(1U << (SCHED_WAIT_BUCKETS - 2)),
+                sched_wait_hist[SCHED_WAIT_BUCKETS - 1]);
+
+        return size;
+}
@@ -0,0 +1,193 @@
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "main/interrupt.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "proc/workq.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/timer.h"
+
+/*
+ * Queued work items, oldest first. The list is touched from interrupt
+ * context, so every access masks interrupts.
+ */
+static list_t workq_list;
+
+/* workd sleeps on this queue while there is nothing to do */
+static ktqueue_t workq_waitq;
+
+static proc_t *workd = NULL;
+static kthread_t *workd_thr = NULL;
+
+static void *workd_run(int arg1, void *arg2);
+static void work_delayed_fired(void *arg);
+
+void
+work_init(work_t *w, work_func_t func, void *arg)
+{
+        KASSERT(NULL != func);
+        list_link_init(&w->w_link);
+        w->w_func = func;
+        w->w_arg = arg;
+        w->w_pending = 0;
+        ktimer_init(&w->w_timer, work_delayed_fired, w);
+        w->w_period = 0;
+}
+
+int
+work_schedule(work_t *w)
+{
+        int queued = 0;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if (!w->w_pending) {
+                w->w_pending = 1;
+                list_insert_tail(&workq_list, &w->w_link);
+                sched_wakeup_on(&workq_waitq);
+                queued = 1;
+        }
+
+        intr_setipl(ipl);
+        return queued;
+}
+
+/* The timer function of a delayed work item */
+static void
+work_delayed_fired(void *arg)
+{
+        work_schedule((work_t *) arg);
+}
+
+/*
+ * The timer function of a periodic work item. Timer functions run
+ * with the timer already removed from the wheel, so it can simply be
+ * added again.
+ */
+static void
+work_periodic_fired(void *arg)
+{
+        work_t *w = (work_t *) arg;
+
+        work_schedule(w);
+        ktimer_add(&w->w_timer, w->w_period);
+}
+
+void
+work_schedule_delayed(work_t *w, uint32_t ticks)
+{
+        if (0 == ticks) {
+                work_schedule(w);
+                return;
+        }
+        w->w_period = 0;
+        ktimer_init(&w->w_timer, work_delayed_fired, w);
+        ktimer_add(&w->w_timer, ticks);
+}
+
+void
+work_schedule_periodic(work_t *w, uint32_t ticks)
+{
+        /* A period of 0 would re-arm the timer into the slot which is
+         * being run, and the wheel would never advance past it */
+        w->w_period = (0 == ticks) ? 1 : ticks;
+        ktimer_init(&w->w_timer, work_periodic_fired, w);
+        ktimer_add(&w->w_timer, w->w_period);
+}
+
+int
+work_cancel(work_t *w)
+{
+        int cancelled;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        /* With interrupts masked the timer cannot be in the middle of
+         * firing, so once it is deleted it stays deleted */
+        cancelled = ktimer_del(&w->w_timer);
+        w->w_period = 0;
+        if (w->w_pending) {
+                list_remove(&w->w_link);
+                w->w_pending = 0;
+                cancelled = 1;
+        }
+
+        intr_setipl(ipl);
+        return cancelled;
+}
+
+static void
+workq_init(void)
+{
+        list_init(&workq_list);
+        sched_queue_init(&workq_waitq);
+
+        KASSERT(curproc && (PID_IDLE == curproc->p_pid)
+                && "should be calling this from idleproc");
+        workd = proc_create("workd");
+        KASSERT(NULL != workd);
+        workd_thr = kthread_create(workd, workd_run, 0, NULL);
+        KASSERT(NULL != workd_thr);
+
+        sched_make_runnable(workd_thr);
+}
+init_func(workq_init);
+init_depends(sched_init);
+
+void
+workq_shutdown(void)
+{
+        KASSERT(PID_IDLE == curproc->p_pid); /* Should call from idleproc */
+        KASSERT(NULL != workd_thr);
+
+        /* workd only notices the cancellation once the list is empty,
+         * so nothing which was queued before shutdown is lost */
+        int pid = workd->p_pid;
+        kthread_cancel(workd_thr, (void *) 0);
+        workd_thr = NULL;
+
+        int child = do_waitpid(pid, 0, NULL);
+        KASSERT(pid == child && "waited on process other than workd");
+}
+
+/*
+ * The work daemon takes items off the front of the list one at a
+ * time and calls them with interrupts enabled. An item is no longer
+ * pending by the time its function runs, so the function (or an
+ * interrupt arriving while it runs) may schedule it again.
+ * Both arguments unused.
+ */
+static void *
+workd_run(int arg1, void *arg2)
+{
+        work_t *w;
+        uint8_t ipl;
+
+        while (1) {
+                ipl = intr_getipl();
+                intr_setipl(IPL_HIGH);
+
+                while (list_empty(&workq_list)) {
+                        if (-EINTR == sched_cancellable_sleep_on(&workq_waitq)) {
+                                intr_setipl(ipl);
+                                kthread_exit((void *) 0);
+                        }
+                }
+
+                w = list_head(&workq_list, work_t, w_link);
+                list_remove(&w->w_link);
+                w->w_pending = 0;
+
+                intr_setipl(ipl);
+
+                w->w_func(w->w_arg);
+        }
+        return NULL;
+}
@@ -0,0 +1,406 @@
+#include "kernel.h"
+#include "globals.h"
+#include "errno.h"
+#include "types.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+#include "util/time.h"
+#include "util/timer.h"
+
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "proc/krwlock.h"
+#include "proc/sched.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/page.h"
+
+#include "vm/vmmap.h"
+#include "vm/futex.h"
+
+#include "api/access.h"
+
+#include "test/usertest.h"
+#include "test/kerntest.h"
+
+/*
+ * The tests wait for the threads they start by sleeping a tick at a
+ * time, so that threads of any priority get to run, and give up after
+ * this many naps rather than hang the shell.
+ */
+#define KERNTEST_NAPS           100
+
+/* The first level of the timer wheel has a slot for each of this many
+ * ticks, timers further off are cascaded down when it wraps around */
+#define KERNTEST_WHEEL_L0       256
+
+/* How many ticks the timer test waits for all of its timers */
+#define KERNTEST_TIMER_LIMIT    (2 * KERNTEST_WHEEL_L0)
+
+#define KERNTEST_ZOMBIES        4
+
+static ktqueue_t kerntest_napq;
+
+static void
+kerntest_nap(void)
+{
+        sched_sleep_on_timeout(&kerntest_napq, 1);
+}
+
+/* Naps until thr is in the given state, returns true if it got there */
+static int
+kerntest_wait_state(kthread_t *thr, int state)
+{
+        int i;
+
+        for (i = 0; i < KERNTEST_NAPS && state != thr->kt_state; ++i)
+                kerntest_nap();
+        return state == thr->kt_state;
+}
+
+/* Starts a process with a single thread running func */
+static proc_t *
+kerntest_spawn(char *name, kthread_func_t func, int arg1, void *arg2,
+               kthread_t **thrp)
+{
+        proc_t *p;
+        kthread_t *thr;
+
+        p = proc_create(name);
+        KASSERT(NULL != p);
+        thr = kthread_create(p, func, arg1, arg2);
+        KASSERT(NULL != thr);
+        sched_make_runnable(thr);
+        if (NULL != thrp)
+                *thrp = thr;
+        return p;
+}
+
+/*
+ * Waits for a child started by kerntest_spawn to exit and reaps it. A
+ * child which has not exited after KERNTEST_NAPS naps is cancelled.
+ * Returns true if the child exited by itself.
+ */
+static int
+kerntest_reap(proc_t *p, kthread_t *thr)
+{
+        pid_t pid = p->p_pid;
+        int i, status;
+
+        for (i = 0; i < KERNTEST_NAPS && PROC_DEAD != p->p_state; ++i)
+                kerntest_nap();
+        if (PROC_DEAD != p->p_state)
+                kthread_cancel(thr, NULL);
+        return pid == do_waitpid(pid, 0, &status) && i < KERNTEST_NAPS;
+}
+
+static void *
+kerntest_noop(int arg1, void *arg2)
+{
+        return NULL;
+}
+
+#ifdef __VM__
+#ifdef __MTP__
+static void *
+futex_waiter(int expected, void *uaddr)
+{
+        return (void *) futex_wait((int *) uaddr, expected);
+}
+#endif
+
+/*
+ * A futex_wait on a value which has already changed must return
+ * without sleeping, and only a matching value puts the thread to sleep
+ * until it is woken.
+ */
+static void
+kerntest_futex(void)
+{
+        vmarea_t *vma;
+        int *uaddr, *misaligned;
+        int val = 7, err;
+
+        err = vmmap_map(curproc->p_vmmap, NULL, 0, 1, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, 0, VMMAP_DIR_HILO, &vma);
+        if (!test_assert(0 <= err, "could not map a page: %d", err))
+                return;
+        uaddr = (int *) PN_TO_ADDR(vma->vma_start);
+        misaligned = (int *)((char *) uaddr + 1);
+        test_assert(0 == copy_to_user(uaddr, &val, sizeof(val)), NULL);
+
+        test_assert(-EWOULDBLOCK == futex_wait(uaddr, val + 1), NULL);
+        test_assert(0 == futex_wake(uaddr, 1), NULL);
+        test_assert(-EINVAL == futex_wait(misaligned, val), NULL);
+        test_assert(-EINVAL == futex_wake(misaligned, 1), NULL);
+
+#ifdef __MTP__
+        {
+                kthread_t *thr;
+                void *ret;
+                int woken;
+
+                thr = kthread_create(curproc, futex_waiter, val, uaddr);
+                KASSERT(NULL != thr);
+                sched_make_runnable(thr);
+                test_assert(kerntest_wait_state(thr, KT_SLEEP_CANCELLABLE),
+                            "futex waiter did not go to sleep");
+
+                woken = futex_wake(uaddr, 2);
+                test_assert(1 == woken, "woke %d threads", woken);
+                if (1 != woken)
+                        kthread_cancel(thr, NULL);
+                test_assert(0 == kthread_join(thr, &ret), NULL);
+                test_assert(1 != woken || 0 == (int) ret,
+                            "woken waiter returned %d", (int) ret);
+        }
+#endif
+
+        vmmap_remove(curproc->p_vmmap, vma->vma_start, 1);
+}
+#endif
+
+static krwlock_t kerntest_rw;
+static int kerntest_seq;
+
+/* Each stores in *result the order it got the lock in, or the error */
+static void *
+rw_writer(int arg1, void *result)
+{
+        int err;
+
+        if (0 == (err = krwlock_wrlock_cancellable(&kerntest_rw))) {
+                *(int *) result = ++kerntest_seq;
+                krwlock_unlock(&kerntest_rw);
+        } else {
+                *(int *) result = err;
+        }
+        return NULL;
+}
+
+static void *
+rw_reader(int arg1, void *result)
+{
+        int err;
+
+        if (0 == (err = krwlock_rdlock_cancellable(&kerntest_rw))) {
+                *(int *) result = ++kerntest_seq;
+                krwlock_unlock(&kerntest_rw);
+        } else {
+                *(int *) result = err;
+        }
+        return NULL;
+}
+
+/*
+ * A waiting writer keeps new readers out even while the lock is held
+ * shared. If the writer is cancelled the readers it held back must be
+ * let in, and when the lock is released with both waiting the writer
+ * goes first.
+ */
+static void
+kerntest_rwlock(void)
+{
+        proc_t *w, *r;
+        kthread_t *wthr, *rthr;
+        int wres = 0, rres = 0;
+
+        krwlock_init(&kerntest_rw);
+        kerntest_seq = 0;
+        krwlock_rdlock(&kerntest_rw);
+
+        w = kerntest_spawn("rwtest-w", rw_writer, 0, &wres, &wthr);
+        test_assert(kerntest_wait_state(wthr, KT_SLEEP_CANCELLABLE),
+                    "writer did not wait for the reader");
+        test_assert(1 == kerntest_rw.krw_wrwant, NULL);
+        r = kerntest_spawn("rwtest-r", rw_reader, 0, &rres, &rthr);
+        test_assert(kerntest_wait_state(rthr, KT_SLEEP_CANCELLABLE),
+                    "reader was not held back by the waiting writer");
+        test_assert(0 == rres, NULL);
+
+        kthread_cancel(wthr, NULL);
+        test_assert(kerntest_reap(w, wthr), NULL);
+        test_assert(-EINTR == wres, "cancelled writer got %d", wres);
+        test_assert(0 == kerntest_rw.krw_wrwant, NULL);
+        test_assert(kerntest_reap(r, rthr),
+                    "reader was not let in when the writer gave up");
+        test_assert(0 < rres, NULL);
+
+        wres = rres = 0;
+        w = kerntest_spawn("rwtest-w", rw_writer, 0, &wres, &wthr);
+        test_assert(kerntest_wait_state(wthr, KT_SLEEP_CANCELLABLE), NULL);
+        r = kerntest_spawn("rwtest-r", rw_reader, 0, &rres, &rthr);
+        test_assert(kerntest_wait_state(rthr, KT_SLEEP_CANCELLABLE), NULL);
+        krwlock_unlock(&kerntest_rw);
+        test_assert(kerntest_reap(w, wthr), NULL);
+        test_assert(kerntest_reap(r, rthr), NULL);
+        test_assert(0 < wres && wres < rres,
+                    "writer got the lock %d, reader %d", wres, rres);
+        test_assert(0 == kerntest_rw.krw_readers, NULL);
+        test_assert(NULL == kerntest_rw.krw_writer, NULL);
+}
+
+typedef struct kerntest_timer {
+        ktimer_t        ktt_timer;
+        uint32_t        ktt_fired;      /* the tick it fired on */
+        int             ktt_done;
+} kerntest_timer_t;
+
+static ktqueue_t kerntest_timerq;
+
+static void
+kerntest_timer_fire(void *arg)
+{
+        kerntest_timer_t *t = (kerntest_timer_t *) arg;
+
+        t->ktt_fired = time_ticks;
+        t->ktt_done = 1;
+        sched_broadcast_on(&kerntest_timerq);
+}
+
+/*
+ * Timers which land in the first level of the wheel, exactly on its
+ * next wraparound, and in the second level (and so are cascaded down
+ * when it wraps) must each fire on the tick they were added for, or
+ * the one after. A timer too far off for the wheel must keep its
+ * expiry rather than be brought forward.
+ */
+static void
+kerntest_timers(void)
+{
+        kerntest_timer_t timers[3], far;
+        uint32_t ticks[3], start;
+        uint8_t ipl;
+        int i, done;
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        start = time_ticks;
+        ticks[0] = 3;
+        ticks[1] = KERNTEST_WHEEL_L0 - (start % KERNTEST_WHEEL_L0);
+        ticks[2] = KERNTEST_WHEEL_L0 + 44;
+        for (i = 0; i < 3; ++i) {
+                timers[i].ktt_done = 0;
+                ktimer_init(&timers[i].ktt_timer, kerntest_timer_fire, &timers[i]);
+                ktimer_add(&timers[i].ktt_timer, ticks[i]);
+                test_assert(start + ticks[i] == timers[i].ktt_timer.kt_expires, NULL);
+        }
+
+        do {
+                for (done = 1, i = 0; i < 3; ++i)
+                        done = done && timers[i].ktt_done;
+                if (done || time_ticks - start >= KERNTEST_TIMER_LIMIT)
+                        break;
+                sched_sleep_on_timeout(&kerntest_timerq, KERNTEST_TIMER_LIMIT);
+        } while (1);
+
+        for (i = 0; i < 3; ++i) {
+                uint32_t expires = timers[i].ktt_timer.kt_expires;
+
+                ktimer_del(&timers[i].ktt_timer);
+                if (!test_assert(timers[i].ktt_done, "timer %d never fired", i))
+                        continue;
+                test_assert((int32_t)(timers[i].ktt_fired - expires) >= 0,
+                            "timer %d fired at %u, before %u", i,
+                            timers[i].ktt_fired, expires);
+                test_assert(timers[i].ktt_fired - expires <= 1,
+                            "timer %d fired at %u, expected %u", i,
+                            timers[i].ktt_fired, expires);
+        }
+
+        start = time_ticks;
+        ktimer_init(&far.ktt_timer, kerntest_timer_fire, &far);
+        ktimer_add(&far.ktt_timer, 1U << 30);
+        test_assert(start + (1U << 30) == far.ktt_timer.kt_expires,
+                    "far timer expires at %u", far.ktt_timer.kt_expires);
+        test_assert(ktimer_pending(&far.ktt_timer), NULL);
+        test_assert(1 == ktimer_del(&far.ktt_timer), NULL);
+        test_assert(!ktimer_pending(&far.ktt_timer), NULL);
+
+        intr_setipl(ipl);
+}
+
+/*
+ * Keeps a few zombies around while enough processes are created and
+ * reaped for the pids to wrap around past them. No pid may be handed
+ * out while another process has it, and the zombies must still be
+ * found and reaped afterwards.
+ */
+static void
+kerntest_pids(void)
+{
+        proc_t *zombies[KERNTEST_ZOMBIES], *p, *q;
+        pid_t zpids[KERNTEST_ZOMBIES], zmax = 0, pid, last;
+        int i, n, status, dup = 0, wrapped = 0;
+
+        for (i = 0; i < KERNTEST_ZOMBIES; ++i) {
+                zombies[i] = kerntest_spawn("pidtest-z", kerntest_noop, 0, NULL, NULL);
+                zpids[i] = zombies[i]->p_pid;
+                if (zpids[i] > zmax)
+                        zmax = zpids[i];
+        }
+        for (i = 0; i < KERNTEST_ZOMBIES; ++i) {
+                for (n = 0; n < KERNTEST_NAPS && PROC_DEAD != zombies[i]->p_state; ++n)
+                        kerntest_nap();
+                test_assert(PROC_DEAD == zombies[i]->p_state, NULL);
+        }
+
+        /* Checking every pid would flood the log, so only whether
+         * any of them went wrong is kept */
+        last = zmax;
+        for (n = 0; n < 2 * PROC_MAX_COUNT && !(wrapped && last > zmax); ++n) {
+                p = kerntest_spawn("pidtest", kerntest_noop, 0, NULL, NULL);
+                pid = p->p_pid;
+                if (pid < last)
+                        wrapped = 1;
+                for (i = 0; i < KERNTEST_ZOMBIES; ++i)
+                        if (pid == zpids[i])
+                                dup = 1;
+                if (p != proc_lookup(pid))
+                        dup = 1;
+                list_iterate_begin(proc_list(), q, proc_t, p_list_link) {
+                        if (q != p && q->p_pid == pid)
+                                dup = 1;
+                } list_iterate_end();
+                if (pid != do_waitpid(pid, 0, &status) || NULL != proc_lookup(pid))
+                        dup = 1;
+                last = pid;
+        }
+        test_assert(wrapped && last > zmax,
+                    "pids did not wrap around past %d", zmax);
+        test_assert(!dup, "a pid in use was handed out again");
+
+        for (i = 0; i < KERNTEST_ZOMBIES; ++i) {
+                test_assert(zombies[i] == proc_lookup(zpids[i]), NULL);
+                test_assert(zpids[i] == do_waitpid(zpids[i], 0, &status), NULL);
+                test_assert(NULL == proc_lookup(zpids[i]), NULL);
+        }
+}
+
+int
+kerntest_main(int argc, char **argv)
+{
+        if (argc != 1) {
+                dbg(DBG_TEST, "USAGE: kerntest\n");
+                return 1;
+        }
+
+        sched_queue_init(&kerntest_napq);
+        sched_queue_init(&kerntest_timerq);
+        test_init();
+
+#ifdef __VM__
+        kerntest_futex();
+#endif
+        kerntest_rwlock();
+        kerntest_timers();
+        kerntest_pids();
+
+        test_fini();
+        return 0;
+}
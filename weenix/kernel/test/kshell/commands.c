@@ -11,9 +11,16 @@
 #include "fs/vnode.h"
 #endif
 
+#include "mm/page.h"
+
+#include "proc/kmutex.h"
+#include "proc/sched.h"
+
+#include "test/kerntest.h"
 #include "test/kshell/io.h"
 
 #include "util/debug.h"
+#include "util/printf.h"
 #include "util/string.h"
 
 int kshell_help(kshell_t *ksh, int argc, char **argv)
@@ -60,6 +67,58 @@ int kshell_echo(kshell_t *ksh, int argc, char **argv)
         return 0;
 }
 
+int kshell_sched(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+
+        if (NULL == (buf = (char *)page_alloc())) {
+                kprintf(ksh, "Out of memory\n");
+                return -ENOMEM;
+        }
+
+        sched_info(NULL, buf, PAGE_SIZE);
+        kshell_write(ksh, buf, strnlen(buf, PAGE_SIZE));
+
+        page_free(buf);
+        return 0;
+}
+
+int kshell_kerntest(kshell_t *ksh, int argc, char **argv)
+{
+        if (argc != 1) {
+                kprintf(ksh, "Usage: kerntest\n");
+                return 0;
+        }
+
+        kerntest_main(argc, argv);
+        kprintf(ksh, "kerntest: done, see the debug log for results\n");
+        return 0;
+}
+
+#ifdef __MUTEXPROF__
+int kshell_mutexes(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int n = 10;
+
+        if (argc > 2 || (argc == 2 && 1 != sscanf(argv[1], "%d", &n))) {
+                kprintf(ksh, "Usage: mutexes [count]\n");
+                return 0;
+        }
+
+        if (NULL == (buf = (char *)page_alloc())) {
+                kprintf(ksh, "Out of memory\n");
+                return -ENOMEM;
+        }
+
+        kmutex_prof_info(&n, buf, PAGE_SIZE);
+        kshell_write(ksh, buf, strnlen(buf, PAGE_SIZE));
+
+        page_free(buf);
+        return 0;
+}
+#endif
+
 #ifdef __VFS__
 int kshell_cat(kshell_t *ksh, int argc, char **argv)
 {
@@ -8,6 +8,11 @@
 KSHELL_CMD(help);
 KSHELL_CMD(exit);
 KSHELL_CMD(echo);
+KSHELL_CMD(sched);
+KSHELL_CMD(kerntest);
+#ifdef __MUTEXPROF__
+KSHELL_CMD(mutexes);
+#endif
 #ifdef __VFS__
 KSHELL_CMD(cat);
 KSHELL_CMD(ls);
@@ -34,6 +34,14 @@ static __attribute__((unused)) void kshell_init()
         kshell_add_command("help", kshell_help,
                            "prints a list of available commands");
         kshell_add_command("echo", kshell_echo, "display a line of text");
+        kshell_add_command("sched", kshell_sched,
+                           "display scheduler statistics");
+        kshell_add_command("kerntest", kshell_kerntest,
+                           "run the kernel tests, results go to the debug log");
+#ifdef __MUTEXPROF__
+        kshell_add_command("mutexes", kshell_mutexes,
+                           "display the most contended mutexes");
+#endif
 #ifdef __VFS__
         kshell_add_command("cat", kshell_cat,
                            "concatenate files and print on the standard output");
@@ -1,3 +1,4 @@
+#include "config.h"
 #include "globals.h"
 
 #include "main/interrupt.h"
@@ -6,9 +7,188 @@
 
 #include "util/debug.h"
 #include "util/init.h"
+#include "util/time.h"
+#include "util/timer.h"
 
 #include "proc/sched.h"
 #include "proc/kthread.h"
 
-#ifdef __UPREEMPT__
+volatile uint32_t time_ticks = 0;
+
+/*
+ * The time stamp counter is calibrated against the PIT at boot. To
+ * keep time_nsecs cheap, cycles are converted to nanoseconds with a
+ * multiply and a shift rather than a (software) 64-bit division:
+ * time_tsc_mult is 2^TSC_SHIFT nanoseconds per cycle.
+ */
+#define TSC_SHIFT 22
+#define TIME_CALIBRATE_MSECS 50
+
+static uint64_t time_tsc_base;
+static uint32_t time_tsc_khz;   /* cycles per millisecond */
+static uint32_t time_tsc_mult = 0;
+
+uint64_t
+time_nsecs(void)
+{
+        uint64_t delta = rdtsc() - time_tsc_base;
+        uint32_t hi = (uint32_t)(delta >> 32);
+        uint32_t lo = (uint32_t) delta;
+
+        /* (delta * mult) >> TSC_SHIFT without a 96-bit product */
+        return (((uint64_t) lo * time_tsc_mult) >> TSC_SHIFT)
+               + (((uint64_t) hi * time_tsc_mult) << (32 - TSC_SHIFT));
+}
+
+#ifdef __TICKLESS__
+/*
+ * In tickless mode the clock is the local APIC timer rather than the
+ * PIT. It ticks periodically while there is something to run, but
+ * when the processor goes idle it is switched to a single one-shot
+ * covering every tick up to the next timer on the wheel, and the
+ * skipped ticks are added to time_ticks all at once when the
+ * processor wakes up, whether because the one-shot ran out or because
+ * some other interrupt came in first.
+ */
+#define LAPIC_TIMER_DIV 16
+
+/* LAPIC timer counts per tick, measured against the PIT at boot */
+static uint32_t time_lapic_tick;
+
+/* The count the idle one-shot was started with, 0 while ticking */
+static uint32_t time_idle_count = 0;
+/* How much of the interrupted tick had already gone by when the
+ * one-shot was started, in LAPIC timer counts */
+static uint32_t time_idle_skew;
+/* Set while a one-shot runs out the rest of a tick the processor woke
+ * up in the middle of, after which the clock ticks periodically again */
+static int time_tick_partial = 0;
+
+static void
+time_tick_start(void)
+{
+        apic_starttimer(time_lapic_tick, LAPIC_TIMER_DIV, INTR_APICTIMER, 1);
+}
+#endif
+
+void
+time_idle_start(void)
+{
+#ifdef __TICKLESS__
+        uint32_t ticks = ktimer_next_expiry() - time_ticks;
+        uint32_t left;
+
+        /* The next tick is needed anyway */
+        if ((int32_t) ticks <= 1)
+                return;
+        if (ticks > 0xffffffff / time_lapic_tick)
+                ticks = 0xffffffff / time_lapic_tick;
+
+        /* End the one-shot on what would have been a tick boundary */
+        left = apic_gettimer();
+        time_idle_skew = time_lapic_tick - left;
+        time_idle_count = (ticks - 1) * time_lapic_tick + left;
+        time_tick_partial = 0;
+        apic_starttimer(time_idle_count, LAPIC_TIMER_DIV, INTR_APICTIMER, 0);
+#endif
+}
+
+void
+time_idle_stop(void)
+{
+#ifdef __TICKLESS__
+        uint32_t elapsed;
+
+        if (0 == time_idle_count)
+                return;
+
+        elapsed = time_idle_count - apic_gettimer() + time_idle_skew;
+        time_ticks += elapsed / time_lapic_tick;
+        time_idle_count = 0;
+
+        /* Woken up partway through a tick, so the next tick comes when
+         * the rest of it has gone by, not a whole tick from now */
+        if (0 != elapsed % time_lapic_tick) {
+                time_tick_partial = 1;
+                apic_starttimer(time_lapic_tick - elapsed % time_lapic_tick,
+                                LAPIC_TIMER_DIV, INTR_APICTIMER, 0);
+        } else {
+                time_tick_start();
+        }
+#endif
+}
+
+/*
+ * The clock interrupt handler. This runs with interrupts disabled on
+ * the stack of whatever thread happened to be running, so it must not
+ * block; anything that might has to be deferred until the interrupted
+ * thread is on its way back out to userland (see sched_preempt).
+ */
+static void
+time_intr_handler(regs_t *regs)
+{
+#ifdef __TICKLESS__
+        /* The LAPIC timer is not routed through the IOAPIC, so the
+         * generic interrupt code does not acknowledge it for us */
+        apic_eoi();
+        if (0 != time_idle_count) {
+                time_idle_stop();
+        } else {
+                ++time_ticks;
+                if (time_tick_partial) {
+                        time_tick_partial = 0;
+                        time_tick_start();
+                }
+        }
+#else
+        ++time_ticks;
+#endif
+        ktimer_run();
+        sched_tick();
+}
+
+/* Measures the TSC (and the LAPIC timer, if it is the clock) against
+ * the PIT */
+static void
+time_calibrate(void)
+{
+        uint64_t cycles;
+
+#ifdef __TICKLESS__
+        apic_starttimer(0xffffffff, LAPIC_TIMER_DIV, INTR_APICTIMER, 0);
+#endif
+        cycles = rdtsc();
+        pit_busywait(TIME_CALIBRATE_MSECS);
+        cycles = rdtsc() - cycles;
+#ifdef __TICKLESS__
+        time_lapic_tick = (0xffffffff - apic_gettimer())
+                          / TIME_CALIBRATE_MSECS * TICK_MSECS;
+        KASSERT(0 != time_lapic_tick);
+#endif
+
+        time_tsc_khz = (uint32_t)(cycles / TIME_CALIBRATE_MSECS);
+        KASSERT(time_tsc_khz >= 1000 && "TSC slower than 1MHz");
+        time_tsc_mult = (uint32_t)(((uint64_t) 1000000 << TSC_SHIFT) / time_tsc_khz);
+        time_tsc_base = rdtsc();
+        dbg(DBG_CORE, "TSC runs at %u kHz\n", time_tsc_khz);
+}
+
+static __attribute__((unused)) void
+time_init(void)
+{
+        time_calibrate();
+#ifdef __TICKLESS__
+        intr_register(INTR_APICTIMER, time_intr_handler);
+        time_tick_start();
+        dbg(DBG_CORE, "tickless clock started, %u LAPIC timer counts per tick\n",
+            time_lapic_tick);
+#else
+        intr_register(INTR_PIT, time_intr_handler);
+        pit_starttimer(INTR_PIT);
 #endif
+        dbg(DBG_CORE, "clock started, %d ms per tick, %d ticks per quantum\n",
+            TICK_MSECS, SCHED_QUANTUM_TICKS);
+}
+init_func(time_init);
+init_depends(sched_init);
+init_depends(ktimer_wheel_init);
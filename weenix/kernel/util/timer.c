@@ -0,0 +1,187 @@
+#include "types.h"
+#include "kernel.h"
+
+#include "main/interrupt.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/time.h"
+#include "util/timer.h"
+
+/*
+ * The timer wheel has TW_LEVELS levels. The first has one slot for
+ * each of the next TW_L0_SIZE ticks, and each further level has
+ * TW_LN_SIZE slots covering TW_LN_SIZE times the span of the level
+ * below it. Adding and deleting a timer is O(1); when the first level
+ * wraps around, the next slot of the level above it is cascaded down
+ * and redistributed. Timers further away than the wheel can hold
+ * (about a week of ticks) wait in its last slot, and are put back in
+ * each time that slot is cascaded until they fit; they still fire at
+ * the tick they were added for.
+ */
+#define TW_L0_BITS      8
+#define TW_LN_BITS      6
+#define TW_L0_SIZE      (1 << TW_L0_BITS)
+#define TW_LN_SIZE      (1 << TW_LN_BITS)
+#define TW_L0_MASK      (TW_L0_SIZE - 1)
+#define TW_LN_MASK      (TW_LN_SIZE - 1)
+#define TW_LEVELS       4
+
+/* The span in ticks covered by levels 0 through n (inclusive) */
+#define TW_SPAN(n)      (1U << (TW_L0_BITS + (n) * TW_LN_BITS))
+/* The slot of tick t in level n > 0 */
+#define TW_INDEX(t, n)  (((t) >> (TW_L0_BITS + ((n) - 1) * TW_LN_BITS)) & TW_LN_MASK)
+
+static list_t tw_level0[TW_L0_SIZE];
+static list_t tw_leveln[TW_LEVELS - 1][TW_LN_SIZE];
+
+/* The next tick the wheel has not yet processed */
+static uint32_t tw_now;
+
+static __attribute__((unused)) void
+ktimer_wheel_init(void)
+{
+        int i, j;
+
+        for (i = 0; i < TW_L0_SIZE; ++i)
+                list_init(&tw_level0[i]);
+        for (i = 0; i < TW_LEVELS - 1; ++i)
+                for (j = 0; j < TW_LN_SIZE; ++j)
+                        list_init(&tw_leveln[i][j]);
+        tw_now = time_ticks;
+}
+init_func(ktimer_wheel_init);
+
+/* Must be called with interrupts masked */
+static void
+tw_insert(ktimer_t *t)
+{
+        uint32_t delta = t->kt_expires - tw_now;
+        list_t *slot;
+        int n;
+
+        if ((int32_t)delta < 0) {
+                /* already expired, run it on the next tick */
+                slot = &tw_level0[tw_now & TW_L0_MASK];
+        } else if (delta < TW_SPAN(0)) {
+                slot = &tw_level0[t->kt_expires & TW_L0_MASK];
+        } else {
+                /* where the timer goes, which is not where it expires if
+                 * that is beyond the wheel; kt_expires is left alone */
+                uint32_t when = t->kt_expires;
+
+                if (delta >= TW_SPAN(TW_LEVELS - 1)) {
+                        delta = TW_SPAN(TW_LEVELS - 1) - 1;
+                        when = tw_now + delta;
+                }
+                for (n = 1; delta >= TW_SPAN(n) && n < TW_LEVELS - 1; ++n);
+                slot = &tw_leveln[n - 1][TW_INDEX(when, n)];
+        }
+        list_insert_tail(slot, &t->kt_link);
+}
+
+/*
+ * Moves every timer in the current slot of level n down into the
+ * lower levels. Returns the index of the slot, which is 0 exactly
+ * when level n itself has wrapped around and the level above it
+ * needs to be cascaded too.
+ */
+static int
+tw_cascade(int n)
+{
+        int index = TW_INDEX(tw_now, n);
+        list_t *slot = &tw_leveln[n - 1][index];
+        ktimer_t *t;
+
+        while (!list_empty(slot)) {
+                t = list_head(slot, ktimer_t, kt_link);
+                list_remove(&t->kt_link);
+                tw_insert(t);
+        }
+        return index;
+}
+
+void
+ktimer_init(ktimer_t *t, ktimer_func_t func, void *arg)
+{
+        KASSERT(NULL != func);
+        list_link_init(&t->kt_link);
+        t->kt_expires = 0;
+        t->kt_func = func;
+        t->kt_arg = arg;
+}
+
+void
+ktimer_add(ktimer_t *t, uint32_t ticks)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        KASSERT(!list_link_is_linked(&t->kt_link) && "timer already pending");
+        t->kt_expires = time_ticks + ticks;
+        tw_insert(t);
+
+        intr_setipl(ipl);
+}
+
+int
+ktimer_del(ktimer_t *t)
+{
+        int pending;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if ((pending = list_link_is_linked(&t->kt_link))) {
+                list_remove(&t->kt_link);
+        }
+
+        intr_setipl(ipl);
+        return pending;
+}
+
+int
+ktimer_pending(ktimer_t *t)
+{
+        return list_link_is_linked(&t->kt_link);
+}
+
+uint32_t
+ktimer_next_expiry(void)
+{
+        uint32_t i, left;
+
+        /* The upper levels are only looked at when level 0 wraps, so
+         * the search stops there: any timer they hold is cascaded into
+         * level 0 then, at the earliest */
+        if (0 == (tw_now & TW_L0_MASK))
+                return tw_now;
+        left = TW_L0_SIZE - (tw_now & TW_L0_MASK);
+        for (i = 0; i < left; ++i) {
+                if (!list_empty(&tw_level0[(tw_now + i) & TW_L0_MASK]))
+                        break;
+        }
+        return tw_now + i;
+}
+
+void
+ktimer_run(void)
+{
+        list_t *slot;
+        ktimer_t *t;
+        int n;
+
+        while ((int32_t)(time_ticks - tw_now) >= 0) {
+                if (0 == (tw_now & TW_L0_MASK)) {
+                        for (n = 1; n < TW_LEVELS && 0 == tw_cascade(n); ++n);
+                }
+
+                slot = &tw_level0[tw_now & TW_L0_MASK];
+                while (!list_empty(slot)) {
+                        t = list_head(slot, ktimer_t, kt_link);
+                        list_remove(&t->kt_link);
+                        t->kt_func(t->kt_arg);
+                }
+                ++tw_now;
+        }
+}
@@ -1,4 +1,5 @@
 #include "globals.h"
+#include "config.h"
 #include "errno.h"
 
 #include "util/string.h"
@@ -11,10 +12,22 @@
 #include "mm/slab.h"
 #include "mm/tlb.h"
 
+#include "vm/anon.h"
+
 int anon_count = 0; /* for debugging/verification purposes */
 
 static slab_allocator_t *anon_allocator;
 
+/*
+ * Pages zeroed while the processor had nothing else to do. A fault on
+ * an anonymous page trades the frame it was given for one of these
+ * rather than zeroing it there and then. Pooled pages come from
+ * page_alloc, so the pool is only topped up while plenty of memory is
+ * free, which also guarantees that page_alloc does not block.
+ */
+static void *anon_zeroed[ANON_ZERO_POOL_SIZE];
+static int anon_nzeroed = 0;
+
 static void anon_ref(mmobj_t *o);
 static void anon_put(mmobj_t *o);
 static int  anon_lookuppage(mmobj_t *o, uint32_t pagenum, int forwrite, pframe_t **pf);
@@ -210,7 +223,13 @@ anon_fillpage(mmobj_t *o, pframe_t *pf)
 
         dbg(DBG_VFS,"VM: Enter anon_fillpage()\n");
 
-        memset(pf->pf_addr, 0, PAGE_SIZE);
+        /* nothing else knows the frame's address yet */
+        if (0 < anon_nzeroed) {
+                page_free(pf->pf_addr);
+                pf->pf_addr = anon_zeroed[--anon_nzeroed];
+        } else {
+                memset(pf->pf_addr, 0, PAGE_SIZE);
+        }
         dbg_print("VM: In anon_fillpage(), pf->pf_addr=0x%x, memset success\n", (uint32_t)pf->pf_addr);
 
         if(!pframe_is_pinned(pf))
@@ -237,3 +256,19 @@ anon_cleanpage(mmobj_t *o, pframe_t *pf)
         /*NOT_YET_IMPLEMENTED("VM: anon_cleanpage");*/
         return -1;
 }
+
+int
+anon_zero_idle(void)
+{
+        void *page;
+
+        if (ANON_ZERO_POOL_SIZE <= anon_nzeroed
+            || page_free_count() <= 4 * ANON_ZERO_POOL_SIZE)
+                return 0;
+
+        page = page_alloc();
+        KASSERT(NULL != page);
+        memset(page, 0, PAGE_SIZE);
+        anon_zeroed[anon_nzeroed++] = page;
+        return 1;
+}
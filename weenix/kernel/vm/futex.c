@@ -0,0 +1,177 @@
+#include "globals.h"
+#include "errno.h"
+#include "types.h"
+#include "config.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/mmobj.h"
+#include "mm/page.h"
+#include "mm/slab.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+
+#include "api/access.h"
+
+#include "vm/vmmap.h"
+#include "vm/futex.h"
+
+/*
+ * A futex exists only while some thread is sleeping on it: the first
+ * waiter creates it and the last one to leave frees it. Futexes are
+ * never touched from interrupt context, and the kernel is not
+ * preemptive, so none of this needs interrupts masked.
+ */
+typedef struct futex {
+        void           *fx_key;         /* mmobj, or vmmap if private */
+        uint32_t        fx_off;         /* byte offset in obj, or address */
+        int             fx_shared;      /* keyed by an mmobj we hold a ref on */
+        ktqueue_t       fx_waitq;
+        int             fx_nwaiters;
+        list_link_t     fx_link;        /* link on the hash chain */
+} futex_t;
+
+#define hash_futex(key, off)  ((((uint32_t)(key)) + ((off) >> 2)) \
+                               % FUTEX_HASH_SIZE)
+static list_t futex_hash[FUTEX_HASH_SIZE];
+
+static slab_allocator_t *futex_allocator = NULL;
+
+static __attribute__((unused)) void
+futex_init(void)
+{
+        int i;
+
+        for (i = 0; i < FUTEX_HASH_SIZE; ++i)
+                list_init(&futex_hash[i]);
+        futex_allocator = slab_allocator_create("futex", sizeof(futex_t));
+        KASSERT(NULL != futex_allocator);
+}
+init_func(futex_init);
+
+/*
+ * Works out what the futex at uaddr is keyed by in the current
+ * process. Shared mappings name the same object in every process
+ * which maps it, so they are keyed by the object and the offset into
+ * it. Private memory is keyed by the address space and address.
+ */
+static int
+futex_key(int *uaddr, mmobj_t **objp, void **key, uint32_t *off)
+{
+        vmarea_t *vma;
+
+        if (0 != ((uintptr_t) uaddr & (sizeof(int) - 1)))
+                return -EINVAL;
+        if (NULL == (vma = vmmap_lookup(curproc->p_vmmap, ADDR_TO_PN(uaddr))))
+                return -EFAULT;
+
+        if (MAP_SHARED == (vma->vma_flags & MAP_TYPE)) {
+                *objp = vma->vma_obj;
+                *key = vma->vma_obj;
+                *off = ((ADDR_TO_PN(uaddr) - vma->vma_start + vma->vma_off)
+                        << PAGE_SHIFT) + PAGE_OFFSET(uaddr);
+        } else {
+                *objp = NULL;
+                *key = curproc->p_vmmap;
+                *off = (uint32_t) uaddr;
+        }
+        return 0;
+}
+
+static futex_t *
+futex_lookup(void *key, uint32_t off)
+{
+        futex_t *fx;
+
+        list_iterate_begin(&futex_hash[hash_futex(key, off)], fx, futex_t, fx_link) {
+                if (fx->fx_key == key && fx->fx_off == off)
+                        return fx;
+        } list_iterate_end();
+        return NULL;
+}
+
+int
+futex_wait(int *uaddr, int expected)
+{
+        mmobj_t *obj;
+        futex_t *fx, *spare;
+        void *key;
+        uint32_t off;
+        int val, err;
+
+        /* Allocating may block too, so a futex is allocated up front
+         * in case there is none to join */
+        if (NULL == (spare = slab_obj_alloc(futex_allocator)))
+                return -ENOMEM;
+
+        /* Reading the value may fault and block, and the mapping may
+         * change meanwhile, so the key is only looked up afterwards.
+         * From here until the thread is on the queue nothing blocks,
+         * so no other thread can change the value and wake us in
+         * between. */
+        err = copy_from_user(&val, uaddr, sizeof(val));
+        if (0 <= err)
+                err = futex_key(uaddr, &obj, &key, &off);
+        if (0 <= err && val != expected)
+                err = -EWOULDBLOCK;
+        if (err < 0) {
+                slab_obj_free(futex_allocator, spare);
+                return err;
+        }
+
+        if (NULL != (fx = futex_lookup(key, off))) {
+                slab_obj_free(futex_allocator, spare);
+        } else {
+                fx = spare;
+                fx->fx_key = key;
+                fx->fx_off = off;
+                sched_queue_init(&fx->fx_waitq);
+                fx->fx_nwaiters = 0;
+                list_insert_tail(&futex_hash[hash_futex(key, off)], &fx->fx_link);
+
+                /* Keep the object from being freed, and its address
+                 * reused as another key, while anyone sleeps on it */
+                if ((fx->fx_shared = (NULL != obj)))
+                        obj->mmo_ops->ref(obj);
+        }
+
+        ++fx->fx_nwaiters;
+        err = sched_cancellable_sleep_on_excl(&fx->fx_waitq, 1);
+        /* If we were woken as well as cancelled, the wakeup was meant
+         * for someone who will still be around to use it */
+        if (-EINTR == err && 1 < fx->fx_nwaiters)
+                sched_wakeup_n(&fx->fx_waitq, 1);
+
+        if (0 == --fx->fx_nwaiters) {
+                list_remove(&fx->fx_link);
+                if (fx->fx_shared) {
+                        obj = fx->fx_key;
+                        obj->mmo_ops->put(obj);
+                }
+                slab_obj_free(futex_allocator, fx);
+        }
+        return err;
+}
+
+int
+futex_wake(int *uaddr, int n)
+{
+        mmobj_t *obj;
+        futex_t *fx;
+        void *key;
+        uint32_t off;
+        int err;
+
+        if ((err = futex_key(uaddr, &obj, &key, &off)) < 0)
+                return err;
+        if (NULL == (fx = futex_lookup(key, off)))
+                return 0;
+
+        return sched_wakeup_n(&fx->fx_waitq, n);
+}
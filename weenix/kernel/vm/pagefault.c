@@ -13,6 +13,7 @@
 #include "mm/mmobj.h"
 #include "mm/pframe.h"
 #include "mm/pagetable.h"
+#include "mm/tlb.h"
 
 #include "vm/pagefault.h"
 #include "vm/vmmap.h"
@@ -111,71 +112,48 @@ handle_pagefault(uintptr_t vaddr, uint32_t cause)
 		}
 	}
 	/*to find the correct page*/
+	/* A write to a private page which is mapped read-only (always
+	 * the case for a while after fork) asks the shadow object for a
+	 * page of its own, copying it. Reads get whatever page is found
+	 * first down the chain and map it read-only, so that the first
+	 * write still faults. */
+	int forwrite = (cause & FAULT_WRITE) ? 1 : 0;
+	uint32_t pagenum = ADDR_TO_PN(vaddr) - fault_vma->vma_start + fault_vma->vma_off;
+	uint32_t inblock = curproc->p_inblock;
 	pframe_t *result_pframe=NULL;
-	
-	
-	/* dbg(DBG_VFS,"VM: before pframe_get\n result_pframe->pf_addr=0x%x\n page_align_up=0x%x\n page_align_down=0x%x, page_offset=0x%x\n", result_pframe->pf_addr,  PAGE_ALIGN_UP(result_pframe->pf_addr), PAGE_ALIGN_DOWN(result_pframe->pf_addr),  PAGE_OFFSET(result_pframe->pf_addr)); */
-	/* if(fault_vma->vma_flags==MAP_PRIVATE && fault_vma->vma_obj->mmo_shadowed!=NULL) */
-	dbg(DBG_VFS,"VM: vma_flags: %d\n", fault_vma->vma_flags);
-
-	if(fault_vma->vma_flags&MAP_PRIVATE )
-	{
-		dbg_print("VM: MAP_PRIVATE, pframe_get\n");
-		/*pframe_get(fault_vma->vma_obj->mmo_shadowed,ADDR_TO_PN(vaddr),&result_pframe);*/
-		pframe_get(fault_vma->vma_obj,PAGE_OFFSET(ADDR_TO_PN(vaddr)),&result_pframe);
-		/*dbg_print("VM: In handle_pagefault(), after pframe_get\n");*/	
 
-		/*
-		fault_vma->vma_obj->mmo_shadowed->mmo_ops->lookuppage(fault_vma->vma_obj->mmo_shadowed,ADDR_TO_PN(vaddr),cause&FAULT_WRITE,&result_pframe);
-		*/
-	}
-	else if(fault_vma->vma_flags&MAP_SHARED)
+	dbg(DBG_VFS,"VM: vma_flags: %d\n", fault_vma->vma_flags);
+	if(0 > pframe_lookup(fault_vma->vma_obj, pagenum, forwrite, &result_pframe))
 	{
-		dbg_print("VM: MAP_SHARED, pframe_get\n");
-		pframe_get(fault_vma->vma_obj,PAGE_OFFSET(ADDR_TO_PN(vaddr)),&result_pframe);
-		dbg_print("VM: In handle_pagefault(), after pframe_get\n");
-		/*
-		fault_vma->vma_obj->mmo_ops->lookuppage(fault_vma->vma_obj,ADDR_TO_PN(vaddr),cause&FAULT_WRITE,&result_pframe);
-		*/
+		proc_kill(curproc, -EFAULT);
+		dbg(DBG_VFS,"VM: Leave handle_pagefault(), pframe_lookup failed\n");
+		return;
 	}
-	uint32_t pdflags=FAULT_USER;
-	uint32_t ptflags=FAULT_USER;
-	if(cause & FAULT_PRESENT)
+	if(forwrite && 0 > pframe_dirty(result_pframe))
 	{
-		ptflags=ptflags|PT_PRESENT;
-		pdflags=pdflags|PD_PRESENT;
+		proc_kill(curproc, -EFAULT);
+		dbg(DBG_VFS,"VM: Leave handle_pagefault(), pframe_dirty failed\n");
+		return;
 	}
-	if(cause & FAULT_WRITE)
+
+	/* a fault is major if it had to read a page in from a file */
+	if(curproc->p_inblock != inblock)
+		curproc->p_majflt++;
+	else
+		curproc->p_minflt++;
+
+	uint32_t pdflags=PD_PRESENT|PD_WRITE|PD_USER;
+	uint32_t ptflags=PT_PRESENT|PT_USER;
+	if(forwrite)
 	{
 		ptflags=ptflags|PT_WRITE;
-		pdflags=pdflags|PD_WRITE;
 	}
-	
-	/*uintptr_t paddr = (uint32_t)result_pframe->pf_addr;
-	
-	pt_map( pt_get(),(uint32_t)PAGE_ALIGN_UP(vaddr),(uint32_t)PAGE_ALIGN_UP(paddr) ,PROT_WRITE|PROT_READ|PROT_EXEC, PROT_WRITE|PROT_READ|PROT_EXEC);*/
-
-
-	/* dbg_print("VM: In handle_pagefault(), pt_map\n"); */
 
-	/*uintptr_t paddr = (uint32_t)result_pframe->pf_addr;*/
-
-	/*
-	pt_map(curproc->p_pagedir,(uint32_t)PAGE_ALIGN_DOWN(vaddr),(uint32_t)PAGE_ALIGN_DOWN((uint32_t)paddr),PROT_WRITE|PROT_READ|PROT_EXEC, PROT_WRITE|PROT_READ|PROT_EXEC);
-	*/
-	dbg(DBG_VFS,"VM: after pframe_get, result_pframe->pf_addr=0x%x\n", (uint32_t)result_pframe->pf_addr);
-	
+	dbg(DBG_VFS,"VM: after pframe_lookup, result_pframe->pf_addr=0x%x\n", (uint32_t)result_pframe->pf_addr);
 	uintptr_t paddr = pt_virt_to_phys((uint32_t)result_pframe->pf_addr);
-	
-
-	/* dbg(DBG_VFS,"VM: before pt_map(), vaddr:0x%x, paddr:0x%x, pdflags:%d, ptflags:%d\n",(uint32_t)PAGE_ALIGN_UP(vaddr), (uint32_t)PAGE_ALIGN_UP(paddr), pdflags, ptflags); */
-	/* char buffer[1024]; */
-    	
-
-	pt_map(curproc->p_pagedir,(uint32_t)PAGE_ALIGN_DOWN(vaddr),(uint32_t)PAGE_ALIGN_DOWN((uint32_t)paddr),PROT_WRITE|PROT_READ|PROT_EXEC, PROT_WRITE|PROT_READ|PROT_EXEC);
-	dbg(DBG_VFS,"VM: after pframe_get\n");
-	/*pt_mapping_info(curproc->p_pagedir, buffer, 1024);
-     	dbg_print("Page table info:\nVritual Address --> Physical Address\n%s\n", buffer);*/
+	pt_map(curproc->p_pagedir,(uint32_t)PAGE_ALIGN_DOWN(vaddr),(uint32_t)PAGE_ALIGN_DOWN((uint32_t)paddr),pdflags,ptflags);
+	/* the old, read-only translation may still be cached */
+	tlb_flush((uint32_t)PAGE_ALIGN_DOWN(vaddr));
 
 	dbg_print("VM: Leave handle_pagefault()\n");
     /*NOT_YET_IMPLEMENTED("VM: handle_pagefault");*/
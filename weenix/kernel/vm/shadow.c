@@ -240,6 +240,7 @@ shadow_fillpage(mmobj_t *o, pframe_t *pf)
                 if(pframe)
                 {
                         memcpy(pf->pf_addr,pframe->pf_addr,PAGE_SIZE);
+                        curproc->p_cowflt++;
                 }
                 else
                 {
@@ -2,6 +2,7 @@
 #include "globals.h"
 
 #include "mm/mmobj.h"
+#include "mm/page.h"
 #include "mm/pframe.h"
 
 #include "util/debug.h"
@@ -32,7 +33,9 @@ shadowd_alloc_sleep()
          * before it has been properly initialized then the system
          * does not have enough memory. */
         KASSERT(shadowd_initialized);
-        sched_sleep_on(&kmem_alloc_waitq);
+        /* the page allocator does not say how many pages it wants, but
+         * it wants at least one */
+        sched_sleep_on_excl(&kmem_alloc_waitq, 1);
 }
 
 /*
@@ -103,7 +106,8 @@ shadowd(int arg1, void *arg2)
                         }
                 } list_iterate_end();
 
-                sched_broadcast_on(&kmem_alloc_waitq);
+                /* only wake as many allocators as can now succeed */
+                sched_wakeup_avail(&kmem_alloc_waitq, page_free_count());
                 if (sched_cancellable_sleep_on(&shadowd_waitq) < 0) {
                         return (void *)0;
                 }
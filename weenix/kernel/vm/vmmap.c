@@ -352,8 +352,12 @@ vmmap_clone(vmmap_t *map)
                     return NULL;
                 newvma->vma_start=iterator->vma_start;
                 newvma->vma_end=iterator->vma_end;
+                newvma->vma_off=iterator->vma_off;
                 newvma->vma_prot=iterator->vma_prot;
                 newvma->vma_flags=iterator->vma_flags;
+                /* the caller decides what the clone's areas map */
+                newvma->vma_obj=NULL;
+                list_link_init(&newvma->vma_olink);
                 vmmap_insert(clonevmm,newvma);
             }list_iterate_end();
         }
@@ -1222,9 +1222,27 @@ static int execute(int argc, char *argv[], redirect_map_t *map)
                 return 0;
         }
 
-        if (!(pid = fork())) {
+        if (0 == map->rm_nfds) {
+                /* There is nothing to set up in the child, so have the
+                 * kernel start the program directly */
+                if (0 > (pid = spawn(argv[0], argv, my_envp)) && errno == ENOENT) {
+                        char buf[256];
+                        snprintf(buf, 255, "/usr/bin/%s", argv[0]);
+                        if (0 > (pid = spawn(buf, argv, my_envp)) && errno == ENOENT) {
+                                fprintf(stderr, "sh: command not found: %s\n", argv[0]);
+                                return -1;
+                        }
+                }
+                if (0 > pid) {
+                        fprintf(stderr, "sh: exec failed for %s: %s\n",
+                                argv[0], strerror(errno));
+                        return -1;
+                }
+        } else if (!(pid = vfork())) {
+                /* We are running in the shell's memory until the exec,
+                 * so we leave with _exit(), which touches none of it */
                 if (do_redirect(map) < 0)
-                        exit(1);
+                        _exit(1);
 
                 execve(argv[0], argv, my_envp);
                 if (errno == ENOENT) {
@@ -1235,10 +1253,10 @@ static int execute(int argc, char *argv[], redirect_map_t *map)
                 } else
                         fprintf(stderr, "sh: exec failed for %s: %s\n",
                                 argv[0], strerror(errno));
-                exit(1);
+                _exit(1);
         } else {
                 if (0 > pid) {
-                        fprintf(stderr, "sh: fork failed errno = %d\n", errno);
+                        fprintf(stderr, "sh: vfork failed errno = %d\n", errno);
                 }
         }
 
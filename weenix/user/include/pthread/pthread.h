@@ -8,6 +8,9 @@ typedef struct pthread          *pthread_t;
 typedef struct pthread_mutex    *pthread_mutex_t;
 typedef struct pthread_cond     *pthread_cond_t;
 
+/* The value joiners of a cancelled thread get back */
+#define PTHREAD_CANCELED ((void *) -1)
+
 /* Attributes NYI */
 typedef int pthread_attr_t;
 typedef int pthread_mutexattr_t;
@@ -35,6 +38,7 @@ int             pthread_mutex_trylock(pthread_mutex_t *mtx);
 int             pthread_mutex_unlock(pthread_mutex_t *mtx);
 void            pthread_yield(void);
 int             pthread_cancel(pthread_t thr);
+pthread_t       pthread_self(void);
 
 /* Everything below NYI */
 #if 0
@@ -87,7 +91,6 @@ int             pthread_rwlockattr_getpshared(const pthread_rwlockattr_t *,
                 int *);
 int             pthread_rwlockattr_setpshared(pthread_rwlockattr_t *, int);
 int             pthread_rwlockattr_destroy(pthread_rwlockattr_t *);
-pthread_t       pthread_self(void);
 int             pthread_setspecific(pthread_key_t, const void *);
 int             pthread_sigmask(int, const sigset_t *, sigset_t *);
 
@@ -17,10 +17,12 @@ struct dirent;
 
 /* User exec-related */
 int     fork(void);
+pid_t   vfork(void);
 int     execl(const char *filename, const char *arg, ...); /* NYI */
 int     execle(const char *filename, const char *arg, ...); /* NYI */
 int     execv(const char *filename, char *const argv[]); /* NYI */
 int     execve(const char *filename, char *const argv[], char *const envp[]);
+pid_t   spawn(const char *filename, char *const argv[], char *const envp[]);
 
 /* Kern-related */
 void    _exit(int status);
@@ -29,8 +31,18 @@ pid_t   waitpid(pid_t pid, int options, int *status);
 void    thr_exit(int status);
 int     thr_errno(void);
 void    thr_set_errno(int n);
+int     thr_create(void *eip, void *esp, int *tidp);
+int     thr_join(int tid, void **retval);
+int     thr_detach(int tid);
+int     thr_cancel(int tid, void *retval);
+void    thr_yield(void);
+int     gettid(void);
+int     futex(int *uaddr, int op, int val);
 void    yield(void);
 pid_t   getpid(void);
+int     nice(int incr);
+unsigned int sleep(unsigned int seconds);
+int     usleep(unsigned int usec);
 int     halt(void);
 void    sync(void);
 
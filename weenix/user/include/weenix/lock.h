@@ -0,0 +1,36 @@
+#pragma once
+
+#include "stddef.h"
+#include "unistd.h"
+
+/*
+ * A minimal lock for libc internals and pthread mutexes: an atomic
+ * exchange, giving the processor to another thread for as long as the
+ * lock is held by someone else.
+ */
+
+typedef volatile int weenix_lock_t;
+
+#define WEENIX_LOCK_INIT 0
+
+static int weenix_trylock(weenix_lock_t *lock)
+{
+        int old = 1;
+        __asm__ volatile("xchgl %0, %1"
+                         : "+r"(old), "+m"(*lock)
+                         :
+                         : "memory");
+        return 0 == old;
+}
+
+static void weenix_lock(weenix_lock_t *lock)
+{
+        while (!weenix_trylock(lock))
+                thr_yield();
+}
+
+static void weenix_unlock(weenix_lock_t *lock)
+{
+        __asm__ volatile("" ::: "memory");
+        *lock = 0;
+}
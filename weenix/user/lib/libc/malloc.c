@@ -16,6 +16,7 @@
 #include "stdlib.h"
 #include "string.h"
 #include "unistd.h"
+#include "weenix/lock.h"
 
 #define __inline__ inline
 
@@ -142,12 +143,15 @@ struct pgfree {
 #define pageround(foo) (((foo) + (malloc_pagemask))&(~(malloc_pagemask)))
 #define ptr2index(foo) (((u_long)(foo) >> malloc_pageshift)-malloc_origo)
 
+/* Serialize the threads of a process */
+static weenix_lock_t malloc_lock = WEENIX_LOCK_INIT;
+
 #ifndef THREAD_LOCK
-#define THREAD_LOCK()
+#define THREAD_LOCK()   weenix_lock(&malloc_lock)
 #endif
 
 #ifndef THREAD_UNLOCK
-#define THREAD_UNLOCK()
+#define THREAD_UNLOCK() weenix_unlock(&malloc_lock)
 #endif
 
 #ifndef MMAP_FD
@@ -0,0 +1,459 @@
+/*
+ * POSIX threads on top of the kernel's thr_* system calls. Every
+ * pthread is a kernel thread in this process; this library only
+ * provides the user stacks, the start routine trampoline and the
+ * bookkeeping needed to free both once a thread is gone.
+ *
+ * Mutexes and condition variables are built on futexes, so they only
+ * enter the kernel when a thread actually has to sleep or there is a
+ * sleeper to wake.
+ *
+ * Note that errno is still per-process, not per-thread.
+ */
+
+#include "errno.h"
+#include "limits.h"
+#include "stdlib.h"
+#include "unistd.h"
+
+#include "pthread/pthread.h"
+#include "weenix/lock.h"
+#include "weenix/syscall.h"
+
+/* Size of the user stack malloc'ed for each new thread */
+#define PTHREAD_STACK_SIZE (64 * 1024)
+
+struct pthread_cleanup {
+        void                  (*pc_func)(void *);
+        void                   *pc_arg;
+        struct pthread_cleanup *pc_next;
+};
+
+struct pthread {
+        int                     pt_tid;         /* kernel thread id */
+        volatile int            pt_live;        /* tid, cleared by the kernel
+                                                 * when the thread exits */
+        int                     pt_detached;
+        void                   *pt_stack;       /* NULL for the main thread */
+        void                 *(*pt_func)(void *);
+        void                   *pt_arg;
+        struct pthread_cleanup *pt_cleanup;     /* innermost handler first */
+        struct pthread         *pt_next;
+};
+
+/* Mutex states */
+#define MUTEX_UNLOCKED  0
+#define MUTEX_LOCKED    1       /* and nobody sleeping on it */
+#define MUTEX_CONTENDED 2       /* and maybe somebody sleeping on it */
+
+struct pthread_mutex {
+        volatile int            pm_state;
+};
+
+struct pthread_cond {
+        volatile int            pc_seq;         /* bumped on every wakeup */
+        volatile int            pc_nwaiters;
+};
+
+/* All threads this library knows about */
+static struct pthread *pthread_list = NULL;
+static weenix_lock_t pthread_list_lock = WEENIX_LOCK_INIT;
+
+/* Serializes the lazy allocation of statically initialized objects */
+static weenix_lock_t pthread_init_lock = WEENIX_LOCK_INIT;
+
+static void
+pthread_free(struct pthread *thr)
+{
+        if (NULL != thr->pt_stack)
+                free(thr->pt_stack);
+        free(thr);
+}
+
+/* Must be called with pthread_list_lock held */
+static void
+pthread_unlink(struct pthread *thr)
+{
+        struct pthread **pp;
+
+        for (pp = &pthread_list; NULL != *pp; pp = &(*pp)->pt_next) {
+                if (*pp == thr) {
+                        *pp = thr->pt_next;
+                        return;
+                }
+        }
+}
+
+/*
+ * Frees every detached thread which has exited since the last sweep.
+ * A detached thread cannot free its own stack while running on it, so
+ * this is left to whichever thread next creates or detaches a thread.
+ */
+static void
+pthread_sweep(void)
+{
+        struct pthread **pp, *thr;
+        struct pthread *dead = NULL;
+
+        weenix_lock(&pthread_list_lock);
+        pp = &pthread_list;
+        while (NULL != (thr = *pp)) {
+                if (thr->pt_detached && 0 == thr->pt_live) {
+                        *pp = thr->pt_next;
+                        thr->pt_next = dead;
+                        dead = thr;
+                } else {
+                        pp = &thr->pt_next;
+                }
+        }
+        weenix_unlock(&pthread_list_lock);
+
+        while (NULL != (thr = dead)) {
+                dead = thr->pt_next;
+                pthread_free(thr);
+        }
+}
+
+/* Where every new thread starts running */
+static void
+pthread_start(struct pthread *self)
+{
+        pthread_exit(self->pt_func(self->pt_arg));
+}
+
+int
+pthread_create(pthread_t *thr, const pthread_attr_t *attr,
+               void *(*func)(void *), void *arg)
+{
+        struct pthread *new;
+        uint32_t *sp;
+        int tid;
+
+        pthread_sweep();
+
+        if (NULL == (new = malloc(sizeof(*new))))
+                return ENOMEM;
+        if (NULL == (new->pt_stack = malloc(PTHREAD_STACK_SIZE))) {
+                free(new);
+                return ENOMEM;
+        }
+        new->pt_live = 0;
+        new->pt_detached = 0;
+        new->pt_func = func;
+        new->pt_arg = arg;
+        new->pt_cleanup = NULL;
+
+        /* Build the frame pthread_start expects to be called with: its
+         * argument above a return address it never uses */
+        sp = (uint32_t *)(((uintptr_t) new->pt_stack + PTHREAD_STACK_SIZE)
+                          & ~(uintptr_t) 15);
+        *--sp = 0;
+        *--sp = 0;
+        *--sp = 0;
+        *--sp = (uint32_t) new;
+        *--sp = 0;
+
+        /* The new thread may look itself up before thr_create returns
+         * here, so it has to be on the list first */
+        weenix_lock(&pthread_list_lock);
+        new->pt_next = pthread_list;
+        pthread_list = new;
+        weenix_unlock(&pthread_list_lock);
+
+        if (0 > (tid = thr_create((void *) pthread_start, sp,
+                                  (int *) &new->pt_live))) {
+                weenix_lock(&pthread_list_lock);
+                pthread_unlink(new);
+                weenix_unlock(&pthread_list_lock);
+                pthread_free(new);
+                return errno;
+        }
+        new->pt_tid = tid;
+
+        *thr = new;
+        return 0;
+}
+
+pthread_t
+pthread_self(void)
+{
+        struct pthread *thr;
+        int tid = gettid();
+
+        weenix_lock(&pthread_list_lock);
+        for (thr = pthread_list; NULL != thr; thr = thr->pt_next) {
+                if (thr->pt_live == tid)
+                        break;
+        }
+        weenix_unlock(&pthread_list_lock);
+        if (NULL != thr)
+                return thr;
+
+        /* Only a thread which this library did not create, i.e. the
+         * main thread, gets here, and only the first time */
+        if (NULL == (thr = malloc(sizeof(*thr))))
+                return NULL;
+        thr->pt_tid = tid;
+        thr->pt_live = tid;
+        thr->pt_detached = 0;
+        thr->pt_stack = NULL;
+        thr->pt_func = NULL;
+        thr->pt_arg = NULL;
+        thr->pt_cleanup = NULL;
+
+        weenix_lock(&pthread_list_lock);
+        thr->pt_next = pthread_list;
+        pthread_list = thr;
+        weenix_unlock(&pthread_list_lock);
+        return thr;
+}
+
+int
+pthread_equal(pthread_t thr1, pthread_t thr2)
+{
+        return thr1 == thr2;
+}
+
+int
+pthread_join(pthread_t thr, void **retval)
+{
+        if (0 > thr_join(thr->pt_tid, retval))
+                return errno;
+
+        weenix_lock(&pthread_list_lock);
+        pthread_unlink(thr);
+        weenix_unlock(&pthread_list_lock);
+        pthread_free(thr);
+        return 0;
+}
+
+int
+pthread_detach(pthread_t thr)
+{
+        if (0 > thr_detach(thr->pt_tid))
+                return errno;
+
+        thr->pt_detached = 1;
+        pthread_sweep();
+        return 0;
+}
+
+void
+pthread_exit(void *retval)
+{
+        struct pthread *self = pthread_self();
+        struct pthread_cleanup *cleanup;
+
+        while (NULL != self && NULL != (cleanup = self->pt_cleanup)) {
+                self->pt_cleanup = cleanup->pc_next;
+                cleanup->pc_func(cleanup->pc_arg);
+                free(cleanup);
+        }
+        thr_exit((int) retval);
+}
+
+int
+pthread_cancel(pthread_t thr)
+{
+        /* Cancellation is asynchronous and does not run the target's
+         * cleanup handlers */
+        if (0 > thr_cancel(thr->pt_tid, PTHREAD_CANCELED))
+                return errno;
+        return 0;
+}
+
+void
+pthread_yield(void)
+{
+        thr_yield();
+}
+
+void
+pthread_cleanup_push(void (*func)(void *), void *arg)
+{
+        struct pthread *self = pthread_self();
+        struct pthread_cleanup *cleanup;
+
+        if (NULL == self || NULL == (cleanup = malloc(sizeof(*cleanup))))
+                return;
+        cleanup->pc_func = func;
+        cleanup->pc_arg = arg;
+        cleanup->pc_next = self->pt_cleanup;
+        self->pt_cleanup = cleanup;
+}
+
+void
+pthread_cleanup_pop(int execute)
+{
+        struct pthread *self = pthread_self();
+        struct pthread_cleanup *cleanup;
+
+        if (NULL == self || NULL == (cleanup = self->pt_cleanup))
+                return;
+        self->pt_cleanup = cleanup->pc_next;
+        if (execute)
+                cleanup->pc_func(cleanup->pc_arg);
+        free(cleanup);
+}
+
+int
+pthread_mutex_init(pthread_mutex_t *mtx, const pthread_mutexattr_t *attr)
+{
+        struct pthread_mutex *m;
+
+        if (NULL == (m = malloc(sizeof(*m))))
+                return ENOMEM;
+        m->pm_state = MUTEX_UNLOCKED;
+        *mtx = m;
+        return 0;
+}
+
+/* A mutex which was only ever zeroed is allocated on first use */
+static struct pthread_mutex *
+pthread_mutex_get(pthread_mutex_t *mtx)
+{
+        if (NULL == *mtx) {
+                weenix_lock(&pthread_init_lock);
+                if (NULL == *mtx)
+                        pthread_mutex_init(mtx, NULL);
+                weenix_unlock(&pthread_init_lock);
+        }
+        return *mtx;
+}
+
+/*
+ * Taking a free mutex is a single compare-and-swap. Otherwise the
+ * mutex is marked contended before sleeping, so that whoever unlocks
+ * it knows to make the system call that wakes us. Having been woken,
+ * there is no telling whether others still sleep, so the mutex is
+ * taken as contended again.
+ */
+int
+pthread_mutex_lock(pthread_mutex_t *mtx)
+{
+        struct pthread_mutex *m;
+        int state;
+
+        if (NULL == (m = pthread_mutex_get(mtx)))
+                return ENOMEM;
+
+        state = __sync_val_compare_and_swap(&m->pm_state, MUTEX_UNLOCKED,
+                                            MUTEX_LOCKED);
+        if (MUTEX_UNLOCKED == state)
+                return 0;
+        if (MUTEX_CONTENDED != state)
+                state = __sync_lock_test_and_set(&m->pm_state, MUTEX_CONTENDED);
+        while (MUTEX_UNLOCKED != state) {
+                futex((int *) &m->pm_state, FUTEX_WAIT, MUTEX_CONTENDED);
+                state = __sync_lock_test_and_set(&m->pm_state, MUTEX_CONTENDED);
+        }
+        return 0;
+}
+
+int
+pthread_mutex_trylock(pthread_mutex_t *mtx)
+{
+        struct pthread_mutex *m;
+
+        if (NULL == (m = pthread_mutex_get(mtx)))
+                return ENOMEM;
+        if (MUTEX_UNLOCKED != __sync_val_compare_and_swap(&m->pm_state,
+                                                          MUTEX_UNLOCKED,
+                                                          MUTEX_LOCKED))
+                return EBUSY;
+        return 0;
+}
+
+int
+pthread_mutex_unlock(pthread_mutex_t *mtx)
+{
+        struct pthread_mutex *m = *mtx;
+
+        if (NULL == m)
+                return EINVAL;
+        if (MUTEX_LOCKED != __sync_fetch_and_sub(&m->pm_state, 1)) {
+                m->pm_state = MUTEX_UNLOCKED;
+                futex((int *) &m->pm_state, FUTEX_WAKE, 1);
+        }
+        return 0;
+}
+
+int
+pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+        struct pthread_cond *c;
+
+        if (NULL == (c = malloc(sizeof(*c))))
+                return ENOMEM;
+        c->pc_seq = 0;
+        c->pc_nwaiters = 0;
+        *cond = c;
+        return 0;
+}
+
+int
+pthread_cond_destroy(pthread_cond_t *cond)
+{
+        if (NULL != *cond) {
+                free(*cond);
+                *cond = NULL;
+        }
+        return 0;
+}
+
+static struct pthread_cond *
+pthread_cond_get(pthread_cond_t *cond)
+{
+        if (NULL == *cond) {
+                weenix_lock(&pthread_init_lock);
+                if (NULL == *cond)
+                        pthread_cond_init(cond, NULL);
+                weenix_unlock(&pthread_init_lock);
+        }
+        return *cond;
+}
+
+int
+pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx)
+{
+        struct pthread_cond *c;
+        int seq;
+
+        if (NULL == (c = pthread_cond_get(cond)))
+                return ENOMEM;
+
+        /* The sequence number is read while the mutex is still held,
+         * so a signal sent after we let go of it changes the number
+         * and the futex does not let us sleep through it */
+        __sync_fetch_and_add(&c->pc_nwaiters, 1);
+        seq = c->pc_seq;
+        pthread_mutex_unlock(mtx);
+        futex((int *) &c->pc_seq, FUTEX_WAIT, seq);
+        __sync_fetch_and_sub(&c->pc_nwaiters, 1);
+        return pthread_mutex_lock(mtx);
+}
+
+static int
+pthread_cond_wake(pthread_cond_t *cond, int n)
+{
+        struct pthread_cond *c;
+
+        if (NULL == (c = pthread_cond_get(cond)))
+                return ENOMEM;
+        __sync_fetch_and_add(&c->pc_seq, 1);
+        if (0 != c->pc_nwaiters)
+                futex((int *) &c->pc_seq, FUTEX_WAKE, n);
+        return 0;
+}
+
+int
+pthread_cond_signal(pthread_cond_t *cond)
+{
+        return pthread_cond_wake(cond, 1);
+}
+
+int
+pthread_cond_broadcast(pthread_cond_t *cond)
+{
+        return pthread_cond_wake(cond, INT_MAX);
+}
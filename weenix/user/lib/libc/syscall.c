@@ -5,6 +5,8 @@
 #include "stdlib.h"
 
 #include "unistd.h"
+#include "time.h"
+#include "resource.h"
 #include "weenix/trap.h"
 
 #include "dirent.h"
@@ -125,11 +127,117 @@ void thr_exit(int status)
         trap(SYS_thr_exit, (uint32_t) status);
 }
 
+int thr_create(void *eip, void *esp, int *tidp)
+{
+        thr_create_args_t args;
+
+        args.tca_eip = eip;
+        args.tca_esp = esp;
+        args.tca_tidp = tidp;
+        return trap(SYS_thr_create, (uint32_t) &args);
+}
+
+int thr_join(int tid, void **retval)
+{
+        thr_join_args_t args;
+
+        args.tja_tid = tid;
+        args.tja_retval = retval;
+        return trap(SYS_thr_join, (uint32_t) &args);
+}
+
+int thr_detach(int tid)
+{
+        return trap(SYS_thr_detach, (uint32_t) tid);
+}
+
+int thr_cancel(int tid, void *retval)
+{
+        thr_cancel_args_t args;
+
+        args.tcla_tid = tid;
+        args.tcla_retval = retval;
+        return trap(SYS_thr_cancel, (uint32_t) &args);
+}
+
+void thr_yield(void)
+{
+        trap(SYS_thr_yield, 0);
+}
+
+int gettid(void)
+{
+        return trap(SYS_gettid, 0);
+}
+
+int futex(int *uaddr, int op, int val)
+{
+        futex_args_t args;
+
+        args.fxa_addr = uaddr;
+        args.fxa_op = op;
+        args.fxa_val = val;
+        return trap(SYS_futex, (uint32_t) &args);
+}
+
 pid_t getpid(void)
 {
         return trap(SYS_getpid, 0);
 }
 
+int nice(int incr)
+{
+        return trap(SYS_nice, (uint32_t) incr);
+}
+
+/* The longest sleep SYS_sleep can take, in whole seconds */
+#define SLEEP_MAX_SECS (0xffffffffU / 1000)
+
+unsigned int sleep(unsigned int seconds)
+{
+        struct timespec start, end;
+        unsigned int secs, slept;
+
+        /* Longer sleeps are cut short rather than overflowing */
+        secs = (seconds > SLEEP_MAX_SECS) ? SLEEP_MAX_SECS : seconds;
+        if (0 > clock_gettime(CLOCK_MONOTONIC, &start))
+                start.tv_sec = -1;
+        if (0 <= trap(SYS_sleep, (uint32_t) secs * 1000))
+                return seconds - secs;
+
+        /* Interrupted, so return the seconds left unslept */
+        if (0 > start.tv_sec || 0 > clock_gettime(CLOCK_MONOTONIC, &end))
+                return seconds;
+        slept = end.tv_sec - start.tv_sec;
+        if (end.tv_nsec < start.tv_nsec)
+                --slept;
+        return (slept < seconds) ? seconds - slept : 0;
+}
+
+int usleep(unsigned int usec)
+{
+        /* rounded up, without overflowing for usec near UINT_MAX */
+        return trap(SYS_sleep, (uint32_t)(usec / 1000 + (0 != usec % 1000)));
+}
+
+int clock_gettime(int clock_id, struct timespec *tp)
+{
+        clock_gettime_args_t args;
+
+        args.cga_clock = clock_id;
+        args.cga_tp = tp;
+        return trap(SYS_clock_gettime, (uint32_t) &args);
+}
+
+int getrusage(int who, struct rusage *usage)
+{
+        getrusage_args_t args;
+
+        args.gra_who = who;
+        args.gra_usage = usage;
+        return trap(SYS_getrusage, (uint32_t) &args);
+}
+
 int halt(void)
 {
         return trap(SYS_halt, 0);
@@ -295,43 +403,70 @@ size_t get_free_mem(void)
         return (size_t) trap(SYS_get_free_mem, 0);
 }
 
-int execve(const char *filename, char *const argv[], char *const envp[])
+/* Vectors this long are built on the stack. After vfork(), anything
+ * malloc()ed before exec would stay behind in the parent's heap. */
+#define EXEC_STACK_ARGS 32
+
+static int build_argvec(argvec_t *vec, char *const v[], argstr_t *buf)
+{
+        size_t i, n;
+
+        for (n = 0; v[n] != NULL; n++)
+                ;
+        vec->av_len = n;
+        if (n < EXEC_STACK_ARGS)
+                vec->av_vec = buf;
+        else if (NULL == (vec->av_vec = malloc((n + 1) * sizeof(argstr_t))))
+                return -1;
+        for (i = 0; i < n; i++) {
+                vec->av_vec[i].as_len = strlen(v[i]);
+                vec->av_vec[i].as_str = v[i];
+        }
+        vec->av_vec[n].as_len = 0;
+        vec->av_vec[n].as_str = NULL;
+        return 0;
+}
+
+static void free_argvec(argvec_t *vec, argstr_t *buf)
 {
-        execve_args_t           args;
+        if (vec->av_vec != buf)
+                free(vec->av_vec);
+}
 
-        int i;
+/* Makes the system call taking an execve_args_t, which returns only if
+ * it fails, for execve, or if it succeeds, for spawn. */
+static int exec_trap(uint32_t num, const char *filename, char *const argv[], char *const envp[])
+{
+        execve_args_t   args;
+        argstr_t        argbuf[EXEC_STACK_ARGS];
+        argstr_t        envbuf[EXEC_STACK_ARGS];
+        int             ret;
 
         args.filename.as_len = strlen(filename);
         args.filename.as_str = filename;
 
-        /* Build argv vector */
-        for (i = 0; argv[i] != NULL; i++)
-                ;
-        args.argv.av_len = i;
-        args.argv.av_vec = malloc((args.argv.av_len + 1) * sizeof(argstr_t));
-        for (i = 0; argv[i] != NULL; i++) {
-                args.argv.av_vec[i].as_len = strlen(argv[i]);
-                args.argv.av_vec[i].as_str = argv[i];
+        if (0 > build_argvec(&args.argv, argv, argbuf))
+                return -1;
+        if (0 > build_argvec(&args.envp, envp, envbuf)) {
+                free_argvec(&args.argv, argbuf);
+                return -1;
         }
-        args.argv.av_vec[i].as_len = 0;
-        args.argv.av_vec[i].as_str = NULL;
 
-        /* Build envp vector */
-        for (i = 0; envp[i] != NULL; i++)
-                ;
-        args.envp.av_len = i;
-        args.envp.av_vec = malloc((args.envp.av_len + 1) * sizeof(argstr_t));
-        for (i = 0; envp[i] != NULL; i++) {
-                args.envp.av_vec[i].as_len = strlen(envp[i]);
-                args.envp.av_vec[i].as_str = envp[i];
-        }
-        args.envp.av_vec[i].as_len = 0;
-        args.envp.av_vec[i].as_str = NULL;
+        ret = trap(num, (uint32_t) &args);
+
+        free_argvec(&args.argv, argbuf);
+        free_argvec(&args.envp, envbuf);
+        return ret;
+}
 
-        /* Note that we don't need to worry about freeing since we are going to exec
-         * (so all our memory will be cleaned up) */
+int execve(const char *filename, char *const argv[], char *const envp[])
+{
+        return exec_trap(SYS_execve, filename, argv, envp);
+}
 
-        return trap(SYS_execve, (uint32_t) &args);
+pid_t spawn(const char *filename, char *const argv[], char *const envp[])
+{
+        return exec_trap(SYS_spawn, filename, argv, envp);
 }
 
 void thr_set_errno(int n)